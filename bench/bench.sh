@@ -0,0 +1,241 @@
+#!/bin/sh
+#
+#  bench.sh
+#
+#  Copyright (c) 2021 by Daniel Kelley
+#
+#  Time the tools on generated inputs and optionally compare with an
+#  earlier run. Inputs come from wktrand with a fixed seed, so every
+#  run, on any machine, times the same data: random points at each
+#  scale, and the Voronoi polygons of those points for polygon heavy
+#  cases. Each case runs with -S and keeps the best wall time of its
+#  repetitions, along with the phase times of that run.
+#
+#  Results are one JSON object with a case per line. With a baseline,
+#  every case slower by more than the tolerance is reported and the
+#  exit status is 1.
+#
+
+set -e
+
+BIN=.
+DATA=bench/data
+OUT=bench.json
+BASELINE=
+SCALES="1000 10000 100000 1000000 10000000"
+VOR_MAX=1000000
+FORMATS="wkt wkb hex"
+REPS=3
+TOLERANCE=10
+NOISE=0.005 # seconds; smaller differences are not regressions
+
+usage()
+{
+    cat >&2 <<EOF
+$0 [-B dir] [-d dir] [-o file] [-b baseline] [-s scales] [-f formats]
+    [-V n] [-r n] [-t percent]
+  -B dir     Tools are in dir (.)
+  -d dir     Generated inputs are kept in dir ($DATA)
+  -o file    Write results to file ($OUT)
+  -b file    Compare with the results in file
+  -s list    Point counts ("$SCALES")
+  -f list    Formats, of wkt wkb hex ("$FORMATS")
+  -V n       Largest point count to make Voronoi input from ($VOR_MAX)
+  -r n       Repetitions, the best counts ($REPS)
+  -t percent Slowdown reported as a regression ($TOLERANCE)
+EOF
+}
+
+while getopts "B:d:o:b:s:f:V:r:t:h" c; do
+    case $c in
+    B) BIN=$OPTARG ;;
+    d) DATA=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    b) BASELINE=$OPTARG ;;
+    s) SCALES=$OPTARG ;;
+    f) FORMATS=$OPTARG ;;
+    V) VOR_MAX=$OPTARG ;;
+    r) REPS=$OPTARG ;;
+    t) TOLERANCE=$OPTARG ;;
+    h) usage; exit 0 ;;
+    *) usage; exit 2 ;;
+    esac
+done
+
+mkdir -p "$DATA"
+SCRATCH=$(mktemp -d)
+trap 'rm -rf "$SCRATCH"' EXIT
+
+# reader flag and wktcat output letter of a format
+flag()
+{
+    case $1 in
+    wkt) echo "" ;;
+    wkb) echo "-b" ;;
+    hex) echo "-B" ;;
+    esac
+}
+
+letter()
+{
+    case $1 in
+    wkt) echo "a" ;;
+    wkb) echo "b" ;;
+    hex) echo "B" ;;
+    esac
+}
+
+# Inputs are made once and reused; the seed makes them the same anyway.
+generate()
+{
+    n=$1
+    pts=$DATA/pts-$n
+    vor=$DATA/vor-$n
+
+    if [ ! -s "$pts.wkt" ]; then
+        echo "generating $n points" >&2
+        "$BIN"/wktrand -s 1 -n "$n" -x 1000 -y 1000 "$pts.wkt"
+    fi
+    if [ "$n" -le "$VOR_MAX" ] && [ ! -s "$vor.wkt" ]; then
+        echo "generating Voronoi polygons of $n points" >&2
+        "$BIN"/wktvor "$pts.wkt" "$vor.wkt"
+    fi
+    for f in $FORMATS; do
+        [ "$f" = wkt ] && continue
+        [ -s "$pts.$f" ] ||
+            "$BIN"/wktcat -o "$(letter "$f")" "$pts.wkt" "$pts.$f"
+        if [ -s "$vor.wkt" ] && [ ! -s "$vor.$f" ]; then
+            "$BIN"/wktcat -o "$(letter "$f")" "$vor.wkt" "$vor.$f"
+        fi
+    done
+}
+
+# The value of key in a -S report.
+field()
+{
+    sed -n "s/.*\"$2\":\\([0-9.e+-]*\\).*/\\1/p" "$1"
+}
+
+phase()
+{
+    sed -n "s/.*\"$2\":{\"seconds\":\\([0-9.e+-]*\\).*/\\1/p" "$1"
+}
+
+# run case format n tool args...: best of REPS, one JSON line
+run()
+{
+    name=$1
+    format=$2
+    n=$3
+    shift 3
+    best=
+    i=0
+    while [ $i -lt "$REPS" ]; do
+        if ! "$@" 2> "$SCRATCH/err" > /dev/null; then
+            cat "$SCRATCH/err" >&2
+            echo "$name $format $n failed" >&2
+            exit 1
+        fi
+        grep '^{"wall_seconds"' "$SCRATCH/err" > "$SCRATCH/stats" || true
+        if [ ! -s "$SCRATCH/stats" ]; then
+            cat "$SCRATCH/err" >&2
+            echo "$name $format $n gave no stats report" >&2
+            exit 1
+        fi
+        wall=$(field "$SCRATCH/stats" wall_seconds)
+        if [ -z "$best" ] ||
+            awk -v a="$wall" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$wall
+            cp "$SCRATCH/stats" "$SCRATCH/best"
+        fi
+        i=$((i + 1))
+    done
+    printf '{"case":"%s","format":"%s","n":%s,"wall_seconds":%s,' \
+           "$name" "$format" "$n" "$best"
+    for p in read compute write plot; do
+        printf '"%s_seconds":%s,' "$p" "$(phase "$SCRATCH/best" $p)"
+    done
+    printf '"peak_rss_bytes":%s}\n' \
+           "$(field "$SCRATCH/best" peak_rss_bytes)"
+    echo "$name $format $n ${best}s" >&2
+}
+
+cases()
+{
+    for n in $SCALES; do
+        generate "$n"
+        for f in $FORMATS; do
+            fl=$(flag "$f")
+            o=$(letter "$f")
+            pts=$DATA/pts-$n.$f
+            vor=$DATA/vor-$n.$f
+            run read-write "$f" "$n" \
+                "$BIN"/wktcat -S $fl -o "$o" "$pts" "$SCRATCH/out"
+            run wktdel "$f" "$n" "$BIN"/wktdel -S $fl "$pts" "$SCRATCH/out"
+            run wktvor "$f" "$n" "$BIN"/wktvor -S $fl "$pts" "$SCRATCH/out"
+            run wkthull "$f" "$n" \
+                "$BIN"/wkthull -S $fl "$pts" "$SCRATCH/out"
+            run wktplot "$f" "$n" "$BIN"/wktplot -S $fl -T svg "$pts"
+            if [ -s "$vor" ]; then
+                run read-write-polygons "$f" "$n" \
+                    "$BIN"/wktcat -S $fl -o "$o" "$vor" "$SCRATCH/out"
+                run wktplot-polygons "$f" "$n" \
+                    "$BIN"/wktplot -S $fl -T svg "$vor"
+            fi
+        done
+    done
+}
+
+cases > "$SCRATCH/cases"
+{
+    echo '{"cases":['
+    sed '$!s/$/,/' "$SCRATCH/cases"
+    echo ']}'
+} > "$OUT"
+echo "results in $OUT" >&2
+
+[ -n "$BASELINE" ] || exit 0
+
+if [ ! -s "$BASELINE" ]; then
+    echo "$BASELINE: no baseline" >&2
+    exit 1
+fi
+
+# Cases are matched by name, format and point count.
+awk -v tolerance="$TOLERANCE" -v noise="$NOISE" '
+function get(line, key,    v) {
+    if (match(line, "\"" key "\":\"?[^,\"}]*")) {
+        v = substr(line, RSTART, RLENGTH)
+        sub(/^"[^"]*":"?/, "", v)
+        return v
+    }
+    return ""
+}
+/"case"/ {
+    key = get($0, "case") " " get($0, "format") " " get($0, "n")
+    if (FILENAME == ARGV[1]) {
+        base[key] = get($0, "wall_seconds")
+    } else {
+        order[++cases] = key
+        now[key] = get($0, "wall_seconds")
+    }
+}
+END {
+    printf "%-32s %12s %12s %8s\n", "case", "baseline", "now", "change"
+    for (i = 1; i <= cases; i++) {
+        key = order[i]
+        if (!(key in base)) {
+            printf "%-32s %12s %12.6f\n", key, "-", now[key]
+            continue
+        }
+        change = base[key] > 0 ? 100 * (now[key] - base[key]) / base[key] : 0
+        slow = change > tolerance && now[key] - base[key] > noise
+        printf "%-32s %12.6f %12.6f %+7.1f%%%s\n", key, base[key], now[key],
+               change, slow ? "  REGRESSION" : ""
+        regressions += slow
+    }
+    if (regressions) {
+        printf "%d regression(s) over %s%%\n", regressions, tolerance
+        exit 1
+    }
+}' "$BASELINE" "$OUT"
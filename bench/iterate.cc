@@ -0,0 +1,221 @@
+/*
+   iterate.cc
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+/*
+ * Sum every coordinate of a file three ways and time each: the C
+ * per-vertex handler of wkt_iterate_coord_seq(), the C span handler of
+ * wkt_iterate_span(), and the templated libwkt::for_each_xy() of
+ * wkt.hpp.
+ * The sums must agree; the times are the best of the repetitions.
+ * Members and simple geometries are also counted through const
+ * lambdas, which have to compile and agree with the C callbacks.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include "wkt.hpp"
+
+struct sum {
+    double s;
+    size_t n;
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int c_vertex(
+    struct wkt *,
+    unsigned int,
+    unsigned int,
+    double x,
+    double y,
+    void *user_data)
+{
+    struct sum *sum = static_cast<struct sum *>(user_data);
+
+    sum->s += x + y;
+    sum->n++;
+
+    return 0;
+}
+
+static int c_span(struct wkt *, const struct wkt_span *span, void *user_data)
+{
+    struct sum *sum = static_cast<struct sum *>(user_data);
+    size_t i;
+
+    for (i=0; i<span->n; i++) {
+        sum->s += span->x[i * span->stride] + span->y[i * span->stride];
+    }
+    sum->n += span->n;
+
+    return 0;
+}
+
+static int c_member(
+    struct wkt *,
+    const GEOSGeometry *,
+    const char *,
+    void *user_data)
+{
+    (*static_cast<size_t *>(user_data))++;
+
+    return 0;
+}
+
+static int c_simple(struct wkt *, const GEOSGeometry *, int, void *user_data)
+{
+    (*static_cast<size_t *>(user_data))++;
+
+    return 0;
+}
+
+/* Each sequence of a simple geometry, through a C handler. */
+template <bool SPAN>
+static int c_visit(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    int type,
+    void *user_data)
+{
+    GEOSContextHandle_t h = wkt->handle;
+    int err;
+    int n;
+    int i;
+
+    if (type != GEOS_POLYGON) {
+        if (SPAN) {
+            return wkt_iterate_span(wkt, geom, c_span, user_data);
+        }
+        return wkt_iterate_coord_seq(wkt, geom, c_vertex, user_data);
+    }
+
+    if (GEOSisEmpty_r(h, geom)) {
+        return 0;
+    }
+    n = GEOSGetNumInteriorRings_r(h, geom);
+    err = c_visit<SPAN>(wkt, GEOSGetExteriorRing_r(h, geom),
+                        GEOS_LINEARRING, user_data);
+    for (i=0; !err && i<n; i++) {
+        err = c_visit<SPAN>(wkt, GEOSGetInteriorRingN_r(h, geom, i),
+                            GEOS_LINEARRING, user_data);
+    }
+
+    return err;
+}
+
+template <class F>
+static double best(int reps, struct sum *sum, F &&f)
+{
+    double t = 0.0;
+    double start;
+    int i;
+
+    for (i=0; i<reps; i++) {
+        sum->s = 0.0;
+        sum->n = 0;
+        start = now();
+        if (f(sum)) {
+            fprintf(stderr, "Iteration failed\n");
+            exit(EXIT_FAILURE);
+        }
+        start = now() - start;
+        if (i == 0 || start < t) {
+            t = start;
+        }
+    }
+
+    return t;
+}
+
+static void report(const char *name, double t, const struct sum *sum)
+{
+    printf("%-24s %10.6f s %8.2f ns/vertex  sum %.17g\n",
+           name, t, sum->n ? t * 1e9 / sum->n : 0.0, sum->s);
+}
+
+int main(int argc, char *argv[])
+{
+    int reps = (argc > 2) ? atoi(argv[2]) : 5;
+    const GEOSGeometry *geom;
+    struct sum vertex;
+    struct sum span;
+    struct sum tmpl;
+    double t;
+    size_t members[2] = { 0, 0 };
+    size_t simples[2] = { 0, 0 };
+
+    if (argc < 2 || reps < 1) {
+        fprintf(stderr, "usage: %s file [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        libwkt::context c;
+
+        if (c.read(argv[1]) || (geom = c.geom()) == nullptr) {
+            return EXIT_FAILURE;
+        }
+
+        t = best(reps, &vertex, [&](struct sum *s) {
+            return wkt_traverse(c.get(), geom, c_visit<false>, s);
+        });
+        report("C vertex handler", t, &vertex);
+
+        t = best(reps, &span, [&](struct sum *s) {
+            return wkt_traverse(c.get(), geom, c_visit<true>, s);
+        });
+        report("C span handler", t, &span);
+
+        t = best(reps, &tmpl, [&](struct sum *s) {
+            return libwkt::for_each_xy(c, geom, [s](double x, double y) {
+                s->s += x + y;
+                s->n++;
+            });
+        });
+        report("C++ for_each_xy", t, &tmpl);
+
+        const auto member = [&members](const GEOSGeometry *, const char *) {
+            members[1]++;
+        };
+        const auto simple = [&simples](const GEOSGeometry *, int) {
+            simples[1]++;
+        };
+        if (wkt_iterate(c.get(), c_member, &members[0]) ||
+            wkt_traverse(c.get(), geom, c_simple, &simples[0]) ||
+            libwkt::iterate(c, member) ||
+            libwkt::traverse(c, geom, simple)) {
+            fprintf(stderr, "Iteration failed\n");
+            return EXIT_FAILURE;
+        }
+
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (vertex.n != tmpl.n || span.n != tmpl.n ||
+        vertex.s != tmpl.s || span.s != tmpl.s) {
+        fprintf(stderr, "Sums differ\n");
+        return EXIT_FAILURE;
+    }
+
+    if (members[0] != members[1] || simples[0] != simples[1]) {
+        fprintf(stderr, "Counts differ\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
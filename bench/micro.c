@@ -0,0 +1,561 @@
+/*
+   micro.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+/*
+ * Microbenchmarks of the libwkt entry points on one input: each case
+ * is run a few times to warm up, then timed over many repetitions,
+ * and summarized by median, 99th percentile and throughput at the
+ * median. Output goes to /dev/null, so nothing but the library is
+ * timed.
+ *
+ * wkt_iterate_parallel() and sessions from a wkt_pool are timed at 1,
+ * 2, 4 .. -p threads, and each run has to see the same members as
+ * serial wkt_iterate() or the benchmark fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wkt.h"
+
+#define REPS_DEFAULT 20
+#define WARMUP_DEFAULT 3
+#define THREADS_DEFAULT 4
+#define MAX_THREADS 64
+#define LINE 64
+
+/* What an iteration saw, one per thread, a cache line each. */
+struct census {
+    size_t members;
+    size_t coords;
+    size_t types; /* sum of the type ids */
+    char pad[LINE - 3 * sizeof(size_t)];
+};
+
+struct bench {
+    struct wkt wkt;
+    const char *input;
+    int reps;
+    int warmup;
+    double *t; /* seconds, one per repetition */
+    size_t vertices;
+    size_t input_bytes;
+    size_t output_bytes;
+    double sum; /* keeps the loops from being optimized away */
+    unsigned int max_threads;
+    unsigned int threads; /* of the case being run */
+    struct census serial; /* what the parallel cases have to match */
+    struct census *slot; /* max_threads of them */
+    struct wkt_pool pool;
+};
+
+struct pooled {
+    struct bench *bench;
+    pthread_t tid;
+    struct census census;
+    int err;
+};
+
+typedef int (*bench_fn_t)(struct bench *bench);
+
+static double w_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int w_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest rank: the smallest sample with at least p of them at or below. */
+static double w_rank(const double *t, int n, double p)
+{
+    int k = (int)(p * n + 0.999999);
+
+    if (k < 1) {
+        k = 1;
+    }
+
+    return t[(k > n ? n : k) - 1];
+}
+
+/*
+ * Time fn, with setup, if any, run untimed before each call. bytes
+ * is what one call goes through, for MB/s; 0 leaves it out.
+ */
+static int w_run(
+    struct bench *bench,
+    const char *name,
+    bench_fn_t setup,
+    bench_fn_t fn,
+    size_t bytes)
+{
+    int err = 0;
+    int i;
+    double start;
+    double median;
+    double mean = 0.0;
+
+    for (i=0; !err && i<bench->warmup + bench->reps; i++) {
+        if (setup) {
+            err = setup(bench);
+        }
+        if (err) {
+            break;
+        }
+        start = w_now();
+        err = fn(bench);
+        if (i >= bench->warmup) {
+            bench->t[i - bench->warmup] = w_now() - start;
+        }
+    }
+    if (err) {
+        fprintf(stderr, "%s failed\n", name);
+        return err;
+    }
+
+    for (i=0; i<bench->reps; i++) {
+        mean += bench->t[i];
+    }
+    mean /= bench->reps;
+    qsort(bench->t, bench->reps, sizeof(*bench->t), w_cmp);
+    median = w_rank(bench->t, bench->reps, 0.5);
+
+    printf("%-10s %12.3f %12.3f %12.3f %12.3f %10.2f",
+           name, 1e6 * bench->t[0], 1e6 * median, 1e6 * mean,
+           1e6 * w_rank(bench->t, bench->reps, 0.99),
+           median > 0 ? bench->vertices / median / 1e6 : 0.0);
+    if (bytes && median > 0) {
+        printf(" %10.2f\n", bytes / median / 1e6);
+    } else {
+        printf(" %10s\n", "-");
+    }
+
+    return err;
+}
+
+static int w_read(struct bench *bench)
+{
+    return wkt_read(&bench->wkt, bench->input);
+}
+
+static int w_forget(struct bench *bench)
+{
+    wkt_forget_bounds(&bench->wkt);
+    return 0;
+}
+
+static int w_bounds(struct bench *bench)
+{
+    double xmin;
+    double xmax;
+    double ymin;
+    double ymax;
+
+    if (!wkt_bounds(&bench->wkt, &xmin, &xmax, &ymin, &ymax)) {
+        return 1;
+    }
+    bench->sum += xmin + xmax + ymin + ymax;
+
+    return 0;
+}
+
+static int w_member(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    const char *gtype,
+    void *user_data)
+{
+    struct bench *bench = user_data;
+
+    (void)wkt;
+    (void)geom;
+    bench->sum += gtype[0];
+
+    return 0;
+}
+
+static int w_iterate(struct bench *bench)
+{
+    return wkt_iterate(&bench->wkt, w_member, bench);
+}
+
+static int w_vertex(
+    struct wkt *wkt,
+    unsigned int i,
+    unsigned int n,
+    double x,
+    double y,
+    void *user_data)
+{
+    struct bench *bench = user_data;
+
+    (void)wkt;
+    (void)i;
+    (void)n;
+    bench->sum += x + y;
+
+    return 0;
+}
+
+/* wkt_iterate_coord_seq() on every sequence, rings included. */
+static int w_visit(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    int type,
+    void *user_data)
+{
+    int err;
+    int n;
+    int i;
+
+    if (type != GEOS_POLYGON) {
+        return wkt_iterate_coord_seq(wkt, geom, w_vertex, user_data);
+    }
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0;
+    }
+
+    n = GEOSGetNumInteriorRings_r(wkt->handle, geom);
+    err = wkt_iterate_coord_seq(wkt, GEOSGetExteriorRing_r(wkt->handle, geom),
+                                w_vertex, user_data);
+    for (i=0; !err && i<n; i++) {
+        err = wkt_iterate_coord_seq(
+            wkt, GEOSGetInteriorRingN_r(wkt->handle, geom, i),
+            w_vertex, user_data);
+    }
+
+    return err;
+}
+
+static int w_coord_seq(struct bench *bench)
+{
+    return wkt_traverse(&bench->wkt, wkt_geometry(&bench->wkt),
+                        w_visit, bench);
+}
+
+static int w_count(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    const char *gtype,
+    void *user_data)
+{
+    struct census *census = user_data;
+    int n = GEOSGetNumCoordinates_r(wkt->handle, geom);
+
+    (void)gtype;
+    if (n < 0) {
+        return 1;
+    }
+    census->members++;
+    census->coords += n;
+    census->types += GEOSGeomTypeId_r(wkt->handle, geom);
+
+    return 0;
+}
+
+static int w_reduce(struct wkt *wkt, void *user_data, void *slot)
+{
+    struct census *total = user_data;
+    const struct census *census = slot;
+
+    (void)wkt;
+    total->members += census->members;
+    total->coords += census->coords;
+    total->types += census->types;
+
+    return 0;
+}
+
+static int w_differs(const struct census *a, const struct census *b)
+{
+    return a->members != b->members ||
+        a->coords != b->coords ||
+        a->types != b->types;
+}
+
+static int w_parallel(struct bench *bench)
+{
+    int err;
+    unsigned int threads = bench->wkt.threads;
+    struct census total;
+
+    memset(&total, 0, sizeof(total));
+    memset(bench->slot, 0, bench->threads * sizeof(*bench->slot));
+
+    bench->wkt.threads = bench->threads;
+    err = wkt_iterate_parallel(&bench->wkt, w_count, bench->slot,
+                               sizeof(*bench->slot), w_reduce, &total);
+    bench->wkt.threads = threads;
+
+    if (!err && w_differs(&total, &bench->serial)) {
+        fprintf(stderr, "Parallel iterate differs from serial\n");
+        err = 1;
+    }
+
+    return err;
+}
+
+/* Read and count the input in a session of the thread's own. */
+static void *w_pooled(void *arg)
+{
+    struct pooled *p = arg;
+    struct wkt *wkt = wkt_pool_get(&p->bench->pool);
+
+    memset(&p->census, 0, sizeof(p->census));
+    p->err = (wkt == NULL ||
+              wkt_read(wkt, p->bench->input) ||
+              wkt_iterate(wkt, w_count, &p->census));
+
+    return NULL;
+}
+
+/*
+ * Fresh threads each time, so after the first run every thread adopts
+ * a session left by one that has exited.
+ */
+static int w_pool(struct bench *bench)
+{
+    int err = 0;
+    unsigned int started;
+    unsigned int i;
+    struct pooled p[MAX_THREADS];
+
+    for (started=0; started<bench->threads; started++) {
+        p[started].bench = bench;
+        if (pthread_create(&p[started].tid, NULL, w_pooled, &p[started])) {
+            fprintf(stderr, "Could not create thread\n");
+            err = 1;
+            break;
+        }
+    }
+
+    for (i=0; i<started; i++) {
+        pthread_join(p[i].tid, NULL);
+        if (!err && (p[i].err || w_differs(&p[i].census, &bench->serial))) {
+            fprintf(stderr, "Pool session %u differs from serial\n", i);
+            err = 1;
+        }
+    }
+
+    return err;
+}
+
+/* Each threaded case at 1, 2, 4 .. max_threads threads. */
+static int w_scale(struct bench *bench, const char *name, bench_fn_t fn)
+{
+    int err = 0;
+    unsigned int threads;
+    char label[32];
+
+    for (threads=1; !err && threads<=bench->max_threads; threads*=2) {
+        snprintf(label, sizeof(label), "%s/%u", name, threads);
+        bench->threads = threads;
+        err = w_run(bench, label, NULL, fn, 0);
+    }
+
+    return err;
+}
+
+static int w_write(struct bench *bench)
+{
+    return wkt_write(&bench->wkt, "/dev/null", wkt_geometry(&bench->wkt));
+}
+
+/* Output size, from one write to a scratch file. */
+static int w_output_bytes(struct bench *bench)
+{
+    char name[] = "/tmp/wktmicroXXXXXX";
+    struct stat st;
+    int fd = mkstemp(name);
+    int err;
+
+    if (fd < 0) {
+        perror(name);
+        return 1;
+    }
+    close(fd);
+
+    err = wkt_write(&bench->wkt, name, wkt_geometry(&bench->wkt));
+    if (!err && stat(name, &st) == 0) {
+        bench->output_bytes = st.st_size;
+    }
+    unlink(name);
+
+    return err;
+}
+
+static int w_cases(struct bench *bench)
+{
+    int err;
+    struct stat st;
+    const GEOSGeometry *geom;
+    int n;
+
+    if (stat(bench->input, &st) < 0) {
+        perror(bench->input);
+        return 1;
+    }
+    bench->input_bytes = st.st_size;
+
+    err = wkt_read(&bench->wkt, bench->input);
+    if (err) {
+        return err;
+    }
+    if (bench->wkt.geom == NULL) {
+        bench->vertices = bench->wkt.flat.n;
+    } else {
+        n = GEOSGetNumCoordinates_r(bench->wkt.handle, bench->wkt.geom);
+        bench->vertices = n > 0 ? n : 0;
+    }
+
+    printf("%s: %zu bytes, %zu vertices, %d repetitions\n",
+           bench->input, bench->input_bytes, bench->vertices, bench->reps);
+    printf("%-10s %12s %12s %12s %12s %10s %10s\n",
+           "case", "min us", "median us", "mean us", "p99 us",
+           "Mvert/s", "MB/s");
+
+    err = w_run(bench, "read", NULL, w_read, bench->input_bytes);
+
+    /* as read, so flat input is bounded without building geometry */
+    if (!err) {
+        err = w_run(bench, "bounds", w_forget, w_bounds, 0);
+    }
+
+    if (!err) {
+        geom = wkt_geometry(&bench->wkt);
+        err = (geom == NULL);
+    }
+    if (!err) {
+        err = w_run(bench, "iterate", NULL, w_iterate, 0);
+    }
+    if (!err) {
+        err = w_run(bench, "coord_seq", NULL, w_coord_seq,
+                    bench->vertices * 2 * sizeof(double));
+    }
+    if (!err) {
+        err = wkt_iterate(&bench->wkt, w_count, &bench->serial);
+    }
+    if (!err) {
+        err = w_scale(bench, "parallel", w_parallel);
+    }
+    if (!err) {
+        err = w_scale(bench, "pool", w_pool);
+    }
+    if (!err) {
+        err = w_output_bytes(bench);
+    }
+    if (!err) {
+        err = w_run(bench, "write", NULL, w_write, bench->output_bytes);
+    }
+
+    return err;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s -rn -wn -jn -pn [-bBh] <input>\n", prog);
+    fprintf(stderr,"  -h        Print this message\n");
+    fprintf(stderr,"  -r n      Timed repetitions (%d)\n", REPS_DEFAULT);
+    fprintf(stderr,"  -w n      Warmup runs (%d)\n", WARMUP_DEFAULT);
+    fprintf(stderr,"  -j n      Parse WKT input and write output with n threads\n");
+    fprintf(stderr,"  -p n      Most threads to iterate with (%d)\n",
+            THREADS_DEFAULT);
+    fprintf(stderr,"  -b        WKB IO\n");
+    fprintf(stderr,"  -B        WKB HEX IO\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int err = 1;
+    int c;
+    struct bench bench;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.reps = REPS_DEFAULT;
+    bench.warmup = WARMUP_DEFAULT;
+    bench.max_threads = THREADS_DEFAULT;
+    bench.wkt.reader = WKT_IO_ASCII;
+    bench.wkt.writer = WKT_IO_ASCII;
+
+    while ((c = getopt(argc, argv, "r:w:j:p:bBh")) != EOF) {
+        switch (c) {
+        case 'r':
+            bench.reps = strtol(optarg,0,0);
+            break;
+        case 'w':
+            bench.warmup = strtol(optarg,0,0);
+            break;
+        case 'j':
+            bench.wkt.threads = strtol(optarg,0,0);
+            break;
+        case 'p':
+            bench.max_threads = strtol(optarg,0,0);
+            break;
+        case 'b':
+            bench.wkt.reader = WKT_IO_BINARY;
+            bench.wkt.writer = WKT_IO_BINARY;
+            break;
+        case 'B':
+            bench.wkt.reader = WKT_IO_HEX;
+            bench.wkt.writer = WKT_IO_HEX;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return(EXIT_SUCCESS);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (optind + 1 != argc || bench.reps < 1 || bench.warmup < 0 ||
+        bench.max_threads < 1 || bench.max_threads > MAX_THREADS) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    bench.input = argv[optind];
+
+    bench.t = calloc(bench.reps, sizeof(*bench.t));
+    bench.slot = calloc(bench.max_threads, sizeof(*bench.slot));
+    if (bench.t == NULL || bench.slot == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(bench.t);
+        free(bench.slot);
+        return EXIT_FAILURE;
+    }
+    if (wkt_pool_init(&bench.pool, &bench.wkt)) {
+        free(bench.t);
+        free(bench.slot);
+        return EXIT_FAILURE;
+    }
+
+    err = wkt_open(&bench.wkt);
+    if (!err) {
+        err = w_cases(&bench);
+    }
+    if (bench.wkt.handle) {
+        wkt_close(&bench.wkt);
+    }
+    wkt_pool_destroy(&bench.pool);
+    free(bench.t);
+    free(bench.slot);
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -12,6 +12,10 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <pthread.h>
 #include <geos_c.h>
 
 typedef enum {
@@ -19,14 +23,169 @@ typedef enum {
     WKT_IO_ASCII,
     WKT_IO_BINARY,
     WKT_IO_HEX,
+    WKT_IO_COLUMNAR,
+    WKT_IO_FGB,
 } wkt_io_t;
 
+/* input compression, detected from magic bytes */
+typedef enum {
+    WKT_Z_NONE,
+    WKT_Z_GZIP,
+    WKT_Z_ZSTD,
+    WKT_Z_XZ,
+} wkt_z_t;
+
+/* phases timed by wkt_stats_begin() and wkt_stats_phase(), in report order */
+typedef enum {
+    WKT_PHASE_SNAG,
+    WKT_PHASE_READ,
+    WKT_PHASE_COMPUTE,
+    WKT_PHASE_WRITE,
+    WKT_PHASE_PLOT,
+    WKT_PHASE_COUNT,
+} wkt_phase_t;
+
+/* counters kept by wkt_stats_count() */
+typedef enum {
+    WKT_STAT_BYTES_MAPPED,
+    WKT_STAT_BYTES_READ,
+    WKT_STAT_GEOMETRIES,
+    WKT_STAT_VERTICES,
+    WKT_STAT_BYTES_WRITTEN,
+    WKT_STAT_PRIMITIVES,
+    WKT_STAT_COUNT,
+} wkt_stat_t;
+
+/* input mapping hints, see struct wkt map_flags */
+#define WKT_MAP_POPULATE 0x1 /* prefault the whole mapping */
+#define WKT_MAP_HUGEPAGE 0x2 /* ask for transparent huge pages */
+
+struct wkt_feed;
+
+/*
+ * Flat coordinate arrays, either from point-only input parsed without
+ * GEOS or straight out of a mapped columnar file.
+ *
+ * type is the GEOS type of the top level geometry. The geometry tree
+ * is stored in preorder: each node has a GEOS type and a count, which
+ * is the number of coordinates for points, linestrings and rings, the
+ * number of rings for polygons, and the number of members for
+ * collections. Coordinates are consumed in node order. nodes == 0 is
+ * shorthand for a collection of n single points. z and m are NULL
+ * unless the input has them.
+ */
+struct wkt_flat {
+    int type;
+    int mapped; /* arrays belong to the input, not the heap */
+    size_t n;
+    const double *x;
+    const double *y;
+    const double *z;
+    const double *m;
+    size_t nodes;
+    const int32_t *node_type;
+    const uint32_t *node_count;
+};
+
+/*
+ * Columnar file layout: this header, then the node type, node count,
+ * x and y columns, and the z and m columns if flagged, at the given
+ * byte offsets, each 8 byte aligned. dims counts the coordinate
+ * columns. Values are in host byte order; a foreign file fails the
+ * version check.
+ */
+#define WKT_COLUMNAR_MAGIC "WKTCOL\r\n"
+#define WKT_COLUMNAR_VERSION 2
+#define WKT_COLUMNAR_Z 0x1
+#define WKT_COLUMNAR_M 0x2
+
+struct wkt_columnar {
+    char magic[8];
+    uint32_t version;
+    uint32_t dims;
+    int32_t type;
+    uint32_t flags;
+    uint64_t nodes;
+    uint64_t coords;
+    uint64_t type_offset;
+    uint64_t count_offset;
+    uint64_t x_offset;
+    uint64_t y_offset;
+    uint64_t z_offset; /* 0 if absent */
+    uint64_t m_offset; /* 0 if absent */
+};
+
+/*
+ * FlatGeobuf: magic (the last byte is the patch level), a size
+ * prefixed header, an optional packed Hilbert R-tree of struct
+ * wkt_node, then size prefixed features. Everything is little-endian.
+ */
+#define WKT_FGB_MAGIC "fgb\3fgb"
+#define WKT_FGB_NODE_SIZE 16
+
+/* R-tree node, byte for byte as stored in a FlatGeobuf index. */
+struct wkt_node {
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    uint64_t offset;
+};
+
+/* Buffered output, see wkt_sink_open(). */
+#define WKT_SINK_SIZE (1024*1024)
+
+struct wkt_sink {
+    int fd;
+    int opened; /* fd is ours to close */
+    int memory; /* no file, buf grows, see wkt_sink_memory() */
+    int err;
+    const char *name;
+    char *buf;
+    size_t len;
+    size_t size; /* of buf in a memory sink */
+};
+
+/* Longest number wkt_dtoa() writes, with the terminator. */
+#define WKT_DTOA_SIZE 32
+
 struct wkt {
     wkt_io_t reader;
     wkt_io_t writer;
+    unsigned int threads; /* parallel parse and write when > 1 */
+    size_t budget; /* out-of-core batch memory in bytes, see wkt_batch() */
     const char *input;
     size_t input_len;
+    char *buffer; /* owned copy of decoded input */
+    char *small; /* read buffer for small inputs, kept across documents */
+    size_t small_size;
+    double *scratch; /* coordinate copies, see wkt_iterate_span() */
+    size_t scratch_size; /* in doubles */
+    struct wkt_feed *feed;
+    unsigned int map_flags;
+    void *map; /* owned input mapping */
+    size_t map_len;
+    size_t map_released; /* leading bytes already given back */
+    int map_fd; /* valid while map is set */
+    struct {
+        int valid;
+        struct wkt_node box;
+    } view; /* only read features touching this box, if indexed */
+    struct {
+        int valid;
+        int places;
+    } precision; /* decimals in written WKT, else shortest round trip */
     GEOSGeometry *geom;
+    struct wkt_flat flat;
+    struct {
+        const GEOSGeometry *of; /* geom when cached, NULL for flat */
+        int valid;
+        struct wkt_node box; /* of everything, see wkt_bounds() */
+        struct wkt_node *feature; /* see wkt_envelopes() */
+        size_t n;
+        struct wkt_node *tree; /* see wkt_index() */
+        size_t leaves;
+    } envelope;
     GEOSWKTReader *wktr;
     GEOSWKBReader *wkbr;
     GEOSWKTWriter *wktw;
@@ -34,39 +193,256 @@ struct wkt {
     GEOSContextHandle_t handle;
 };
 
+/*
+ * Open sessions kept for reuse, one per thread, see wkt_pool_get().
+ * proto holds the settings every session starts from.
+ */
+struct wkt_pool_entry;
+
+struct wkt_pool {
+    struct wkt proto;
+    pthread_key_t key;
+    struct wkt_pool_entry *entries;
+};
+
 typedef int (*wkt_iterator_t)(
     struct wkt *wkt,
     const GEOSGeometry *geom,
     const char *gtype,
     void *user_data);
 
+/* Merges one thread's slot into user_data, see wkt_iterate_parallel(). */
+typedef int (*wkt_reduce_t)(
+    struct wkt *wkt,
+    void *user_data,
+    void *slot);
+
+/*
+ * A run of coordinates: coordinate i is x[i * stride], y[i * stride]
+ * and so on. z and m are NULL when the coordinates have none. type is
+ * the GEOS type of the geometry they belong to.
+ */
+struct wkt_span {
+    size_t n;
+    unsigned int stride;
+    int type;
+    const double *x;
+    const double *y;
+    const double *z;
+    const double *m;
+};
+
+typedef int (*wkt_span_t)(
+    struct wkt *wkt,
+    const struct wkt_span *span,
+    void *user_data);
+
+/* Called by wkt_traverse() with each simple geometry and its type id. */
+typedef int (*wkt_visitor_t)(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    int type,
+    void *user_data);
+
+/*
+ * Writes member i of collection geom into sink, the collection
+ * header included when i is 0, see wkt_write_parallel().
+ */
+typedef int (*wkt_member_t)(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int i);
+
+/* Called with one batch of the input in wkt->geom. */
+typedef int (*wkt_batch_t)(
+    struct wkt *wkt,
+    const struct wkt_node *extent,
+    void *user_data);
+
 extern int wkt_open(struct wkt *wkt);
+extern void wkt_messages(GEOSContextHandle_t handle);
 extern int wkt_read(struct wkt *wkt, const char *file);
+extern int wkt_read_parallel(struct wkt *wkt);
+extern int wkt_read_points(struct wkt *wkt);
+extern int wkt_read_columnar(struct wkt *wkt);
+extern int wkt_read_fgb(struct wkt *wkt);
+extern GEOSGeometry *wkt_geometry(struct wkt *wkt);
+extern GEOSGeometry *wkt_coords(struct wkt *wkt);
+extern void wkt_flat_free(struct wkt *wkt);
+extern int wkt_flat_subtree(
+    const struct wkt_flat *flat,
+    size_t *node,
+    size_t *coords);
 extern int wkt_snag(struct wkt *wkt, const char *file);
+extern int wkt_source(struct wkt *wkt, const char *file);
+extern int wkt_release(struct wkt *wkt, size_t offset);
+extern void wkt_unmap(struct wkt *wkt);
+extern wkt_z_t wkt_feed_detect(const unsigned char *magic, size_t len);
+extern int wkt_feed_open(
+    struct wkt *wkt,
+    int fd,
+    wkt_z_t z,
+    const unsigned char *prefix,
+    size_t len,
+    const char *name);
+extern ssize_t wkt_feed_read(struct wkt *wkt, char *data, size_t len);
+extern int wkt_feed_slurp(struct wkt *wkt);
+extern void wkt_feed_close(struct wkt *wkt);
+extern void wkt_reset(struct wkt *wkt);
 extern int wkt_close(struct wkt *wkt);
+extern int wkt_pool_init(struct wkt_pool *pool, const struct wkt *proto);
+extern struct wkt *wkt_pool_get(struct wkt_pool *pool);
+extern void wkt_pool_destroy(struct wkt_pool *pool);
 extern int wkt_iterate_coord_seq(
     struct wkt *wkt,
     const GEOSGeometry *geom,
     int (*handler)(struct wkt *, unsigned, unsigned, double, double, void *),
     void *user_data);
+extern double *wkt_scratch(struct wkt *wkt, size_t n);
+extern int wkt_iterate_span(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_span_t handler,
+    void *user_data);
+extern int wkt_iterate_flat_span(
+    struct wkt *wkt,
+    int type,
+    wkt_span_t handler,
+    void *user_data);
 extern int wkt_bounds(
     struct wkt *wkt,
     double *xmin,
     double *xmax,
     double *ymin,
     double *ymax);
+extern void wkt_forget_bounds(struct wkt *wkt);
+extern const struct wkt_node *wkt_envelopes(struct wkt *wkt, size_t *n);
+extern int wkt_index(struct wkt *wkt);
+extern int wkt_query(
+    struct wkt *wkt,
+    const struct wkt_node *box,
+    wkt_iterator_t iterator,
+    void *user_data);
+extern void wkt_minmax(
+    const double *x,
+    const double *y,
+    size_t n,
+    struct wkt_node *box);
+extern int wkt_bounds_z(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    double *zmin,
+    double *zmax);
 extern int wkt_iterate(
     struct wkt *wkt,
     wkt_iterator_t iterator,
     void *user_data);
+extern int wkt_iterate_one(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_iterator_t iterator,
+    void *user_data);
+extern int wkt_iterate_parallel(
+    struct wkt *wkt,
+    wkt_iterator_t iterator,
+    void *slots,
+    size_t slot_size,
+    wkt_reduce_t reduce,
+    void *user_data);
+extern const char *wkt_type_name(int type);
+extern int wkt_traverse(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_visitor_t visitor,
+    void *user_data);
+extern int wkt_iterate_flat(
+    struct wkt *wkt,
+    int type,
+    int (*handler)(struct wkt *, unsigned, unsigned, double, double, void *),
+    void *user_data);
 extern int wkt_write(
     struct wkt *wkt,
     const char *file,
     const GEOSGeometry *geom);
+extern int wkt_write_text(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom);
+extern int wkt_write_text_member(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int i);
+extern size_t wkt_dtoa(double v, int places, char *buf);
+extern int wkt_write_parallel(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int first,
+    wkt_member_t member);
+extern int wkt_write_columnar(
+    struct wkt *wkt,
+    const char *file,
+    const GEOSGeometry *geom);
+extern int wkt_write_fgb(
+    struct wkt *wkt,
+    const char *file,
+    const GEOSGeometry *geom);
+extern size_t wkt_rtree_nodes(size_t n, unsigned int node_size);
+extern int wkt_rtree_sort(struct wkt_node *leaf, size_t n);
+extern void wkt_rtree_expand(struct wkt_node *node, const struct wkt_node *with);
+extern void wkt_rtree_build(
+    struct wkt_node *node,
+    size_t n,
+    unsigned int node_size);
+extern int wkt_rtree_search(
+    const void *index,
+    size_t n,
+    unsigned int node_size,
+    const struct wkt_node *box,
+    int (*hit)(const struct wkt_node *leaf, size_t i, void *user_data),
+    void *user_data);
 extern int wkt_stash(
     const char *file,
     const char *data,
     size_t len);
+extern int wkt_sink_open(struct wkt_sink *sink, const char *file);
+extern int wkt_sink_memory(struct wkt_sink *sink);
+extern int wkt_sink_write(struct wkt_sink *sink, const void *data, size_t len);
+extern int wkt_sink_writev(struct wkt_sink *sink, struct iovec *iov, int n);
+extern int wkt_sink_close(struct wkt_sink *sink);
+extern int wkt_stream(
+    struct wkt *wkt,
+    const char *file,
+    wkt_iterator_t iterator,
+    void *user_data);
+extern int wkt_stream_split(
+    struct wkt *wkt,
+    const char *file,
+    wkt_iterator_t iterator,
+    void *user_data);
+extern int wkt_stream_points(struct wkt *wkt, const char *file);
+extern int wkt_batch(
+    struct wkt *wkt,
+    const char *file,
+    int records,
+    wkt_batch_t batch,
+    void *user_data);
+extern int wkt_parse_size(const char *arg, size_t *size);
+extern void wkt_stats_enable(const char *trace);
+extern void wkt_stats_memory(void);
+extern uint64_t wkt_stats_now(void);
+extern uint64_t wkt_stats_begin(wkt_phase_t phase);
+extern void wkt_stats_add(wkt_phase_t phase, uint64_t start);
+extern void wkt_stats_phase(wkt_phase_t phase, uint64_t start);
+extern void wkt_stats_trace(const char *name, uint64_t start);
+extern void wkt_stats_count(wkt_stat_t stat, uint64_t n);
+extern void wkt_stats_parsed(struct wkt *wkt, const GEOSGeometry *geom);
+extern void wkt_stats_mapped(int64_t bytes);
+extern void wkt_stats_alloc(void *ptr);
+extern void wkt_stats_free(void *ptr);
+extern int wkt_stats_report(void);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,386 @@
+/*
+   wkt.hpp
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#ifndef   _WKT_HPP_
+#define   _WKT_HPP_
+
+/*
+ * C++17 interface to libwkt, header only. Handles own a struct wkt or
+ * a GEOS geometry and can be moved but not copied. Iteration takes any
+ * callable and instantiates a loop for it, so per coordinate work is
+ * inlined instead of going through a function pointer and a void
+ * pointer for every vertex.
+ *
+ * Callables may return void or an int error, 1 on failure as in the C
+ * interface; iteration stops at the first error and returns it. Only
+ * construction throws, since it has no other way to fail.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "wkt.h"
+
+namespace libwkt {
+
+class error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+/* f(args...) as an int error, 0 when f returns nothing. */
+template <class F, class... Args>
+inline int call(F &f, Args &&...args)
+{
+    if constexpr (std::is_void_v<std::invoke_result_t<F &, Args...>>) {
+        f(std::forward<Args>(args)...);
+        return 0;
+    } else {
+        return static_cast<int>(f(std::forward<Args>(args)...));
+    }
+}
+
+struct close_wkt {
+    void operator()(struct wkt *w) const
+    {
+        if (w->handle) {
+            wkt_close(w);
+        }
+        delete w;
+    }
+};
+
+} // namespace detail
+
+/* One coordinate; z and m are 0 when the geometry has none. */
+struct coord {
+    double x;
+    double y;
+    double z;
+    double m;
+};
+
+/*
+ * A struct wkt_span as a range of coords, good for as long as the
+ * span it was made from.
+ */
+class span {
+public:
+    class iterator {
+    public:
+        iterator(const struct wkt_span *s, std::size_t i) : s_(s), i_(i) {}
+        coord operator*() const
+        {
+            std::size_t k = i_ * s_->stride;
+            return coord{s_->x[k], s_->y[k],
+                         s_->z ? s_->z[k] : 0.0,
+                         s_->m ? s_->m[k] : 0.0};
+        }
+        iterator &operator++()
+        {
+            ++i_;
+            return *this;
+        }
+        bool operator!=(const iterator &o) const { return i_ != o.i_; }
+        bool operator==(const iterator &o) const { return i_ == o.i_; }
+
+    private:
+        const struct wkt_span *s_;
+        std::size_t i_;
+    };
+
+    explicit span(const struct wkt_span &s) : s_(&s) {}
+
+    std::size_t size() const { return s_->n; }
+    bool empty() const { return s_->n == 0; }
+    int type() const { return s_->type; }
+    bool has_z() const { return s_->z != nullptr; }
+    bool has_m() const { return s_->m != nullptr; }
+    double x(std::size_t i) const { return s_->x[i * s_->stride]; }
+    double y(std::size_t i) const { return s_->y[i * s_->stride]; }
+    double z(std::size_t i) const { return s_->z[i * s_->stride]; }
+    double m(std::size_t i) const { return s_->m[i * s_->stride]; }
+    iterator begin() const { return iterator(s_, 0); }
+    iterator end() const { return iterator(s_, s_->n); }
+    const struct wkt_span &get() const { return *s_; }
+
+private:
+    const struct wkt_span *s_;
+};
+
+/*
+ * Calls f(x, y) for each coordinate of s. The two strides in use, 1
+ * for flat arrays and 2 for XY copies, get loops of their own that the
+ * compiler can unroll and vectorize.
+ */
+template <class F>
+inline int for_each_xy(const span &s, F &&f)
+{
+    const struct wkt_span &r = s.get();
+    std::size_t i;
+    int err = 0;
+
+    if (r.stride == 1) {
+        for (i=0; !err && i<r.n; i++) {
+            err = detail::call(f, r.x[i], r.y[i]);
+        }
+    } else if (r.stride == 2) {
+        for (i=0; !err && i<r.n; i++) {
+            err = detail::call(f, r.x[2 * i], r.y[2 * i]);
+        }
+    } else {
+        for (i=0; !err && i<r.n; i++) {
+            err = detail::call(f, r.x[i * r.stride], r.y[i * r.stride]);
+        }
+    }
+
+    return err;
+}
+
+/* An owned GEOS geometry, destroyed with the context it came from. */
+class geometry {
+public:
+    geometry() = default;
+    geometry(GEOSContextHandle_t handle, GEOSGeometry *g)
+        : geom_(g, deleter{handle}) {}
+
+    GEOSGeometry *get() const { return geom_.get(); }
+    GEOSGeometry *release() { return geom_.release(); }
+    explicit operator bool() const { return geom_ != nullptr; }
+
+private:
+    struct deleter {
+        GEOSContextHandle_t handle;
+        void operator()(GEOSGeometry *g) const
+        {
+            GEOSGeom_destroy_r(handle, g);
+        }
+    };
+
+    std::unique_ptr<GEOSGeometry, deleter> geom_{nullptr, deleter{nullptr}};
+};
+
+/*
+ * An open struct wkt. The struct stays where it was allocated, so a
+ * pointer from get() survives moving the handle.
+ */
+class context {
+public:
+    explicit context(wkt_io_t reader = WKT_IO_ASCII,
+                     wkt_io_t writer = WKT_IO_ASCII,
+                     unsigned int threads = 0)
+        : wkt_(new struct wkt())
+    {
+        wkt_->reader = reader;
+        wkt_->writer = writer;
+        wkt_->threads = threads;
+        if (wkt_open(wkt_.get())) {
+            throw error("Could not open libwkt context");
+        }
+    }
+
+    struct wkt *get() const { return wkt_.get(); }
+    struct wkt *operator->() const { return wkt_.get(); }
+    GEOSContextHandle_t handle() const { return wkt_->handle; }
+
+    int read(const char *file) { return wkt_read(wkt_.get(), file); }
+
+    /* Built on first use and owned by the context, see wkt_geometry(). */
+    const GEOSGeometry *geom() const { return wkt_geometry(wkt_.get()); }
+
+    int write(const char *file, const GEOSGeometry *g) const
+    {
+        return wkt_write(wkt_.get(), file, g);
+    }
+
+    /* Take ownership of a GEOS result made with this context. */
+    geometry own(GEOSGeometry *g) const { return geometry(handle(), g); }
+
+private:
+    std::unique_ptr<struct wkt, detail::close_wkt> wkt_;
+};
+
+namespace detail {
+
+template <class F>
+int member_thunk(
+    struct wkt *,
+    const GEOSGeometry *geom,
+    const char *gtype,
+    void *user_data)
+{
+    return call(*static_cast<F *>(user_data), geom, gtype);
+}
+
+template <class F>
+int visitor_thunk(
+    struct wkt *,
+    const GEOSGeometry *geom,
+    int type,
+    void *user_data)
+{
+    return call(*static_cast<F *>(user_data), geom, type);
+}
+
+template <class F>
+int span_thunk(struct wkt *, const struct wkt_span *s, void *user_data)
+{
+    return call(*static_cast<F *>(user_data), span(*s));
+}
+
+/*
+ * The sequence of a point, line string or ring as one span. With XY
+ * set Z and M are dropped in the copy, which saves asking GEOS about
+ * them for every sequence.
+ */
+template <bool XY, class F>
+int seq(struct wkt *w, const GEOSGeometry *g, int type, F &f)
+{
+    GEOSContextHandle_t h = w->handle;
+    const GEOSCoordSequence *s = GEOSGeom_getCoordSeq_r(h, g);
+    int has_z = !XY && (GEOSHasZ_r(h, g) == 1);
+    int has_m = !XY && (GEOSHasM_r(h, g) == 1);
+    unsigned int n;
+    struct wkt_span r;
+    double *xy;
+
+    if (s == nullptr || !GEOSCoordSeq_getSize_r(h, s, &n)) {
+        return 1;
+    }
+
+    r.n = n;
+    r.stride = 2 + has_z + has_m;
+    r.type = type;
+    xy = wkt_scratch(w, static_cast<std::size_t>(n) * r.stride);
+    if (n && (xy == nullptr ||
+              !GEOSCoordSeq_copyToBuffer_r(h, s, xy, has_z, has_m))) {
+        return 1;
+    }
+    r.x = xy;
+    r.y = xy + 1;
+    r.z = has_z ? xy + 2 : nullptr;
+    r.m = has_m ? xy + 2 + has_z : nullptr;
+
+    return call(f, span(r));
+}
+
+template <bool XY, class F>
+int spans(struct wkt *w, const GEOSGeometry *g, F &f)
+{
+    GEOSContextHandle_t h = w->handle;
+    int type = GEOSGeomTypeId_r(h, g);
+    int err = 0;
+    int n;
+    int i;
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        return seq<XY>(w, g, type, f);
+    case GEOS_POLYGON:
+        if (GEOSisEmpty_r(h, g)) {
+            return 0;
+        }
+        n = GEOSGetNumInteriorRings_r(h, g);
+        err = seq<XY>(w, GEOSGetExteriorRing_r(h, g), GEOS_LINEARRING, f);
+        for (i=0; !err && i<n; i++) {
+            err = seq<XY>(w, GEOSGetInteriorRingN_r(h, g, i),
+                          GEOS_LINEARRING, f);
+        }
+        return err;
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        n = GEOSGetNumGeometries_r(h, g);
+        for (i=0; !err && i<n; i++) {
+            err = spans<XY>(w, GEOSGetGeometryN_r(h, g, i), f);
+        }
+        return err;
+    default:
+        return 1;
+    }
+}
+
+} // namespace detail
+
+/*
+ * The callbacks below go to C as a void pointer, so each is moved or
+ * copied into a local first: a const callable has no such pointer.
+ */
+
+/* f(geom, gtype) for each top level member, see wkt_iterate(). */
+template <class F>
+inline int iterate(context &c, F &&f)
+{
+    std::decay_t<F> fn(std::forward<F>(f));
+
+    return wkt_iterate(c.get(), detail::member_thunk<std::decay_t<F>>,
+                       &fn);
+}
+
+/* f(geom, gtype) for each member meeting box, see wkt_query(). */
+template <class F>
+inline int query(context &c, const struct wkt_node &box, F &&f)
+{
+    std::decay_t<F> fn(std::forward<F>(f));
+
+    return wkt_query(c.get(), &box, detail::member_thunk<std::decay_t<F>>,
+                     &fn);
+}
+
+/* f(geom, type) for each simple geometry in geom, see wkt_traverse(). */
+template <class F>
+inline int traverse(context &c, const GEOSGeometry *geom, F &&f)
+{
+    std::decay_t<F> fn(std::forward<F>(f));
+
+    return wkt_traverse(c.get(), geom,
+                        detail::visitor_thunk<std::decay_t<F>>, &fn);
+}
+
+/*
+ * f(span) for every coordinate sequence in geom, rings included, in
+ * order. The walk is instantiated for f, so nothing is called through
+ * a pointer. Spans share the context's scratch buffer and are only
+ * good until f returns.
+ */
+template <class F>
+inline int for_each_span(context &c, const GEOSGeometry *geom, F &&f)
+{
+    return detail::spans<false>(c.get(), geom, f);
+}
+
+/* f(span) for flat input, see wkt_iterate_flat_span(); type < 0 is all. */
+template <class F>
+inline int for_each_flat_span(context &c, int type, F &&f)
+{
+    std::decay_t<F> fn(std::forward<F>(f));
+
+    return wkt_iterate_flat_span(c.get(), type,
+                                 detail::span_thunk<std::decay_t<F>>, &fn);
+}
+
+/* f(x, y) for every coordinate in geom, Z and M left out. */
+template <class F>
+inline int for_each_xy(context &c, const GEOSGeometry *geom, F &&f)
+{
+    auto xy = [&f](const span &s) {
+        return for_each_xy(s, f);
+    };
+
+    return detail::spans<true>(c.get(), geom, xy);
+}
+
+} // namespace libwkt
+
+#endif // _WKT_HPP_
@@ -0,0 +1,371 @@
+/*
+   wkt_batch.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "wkt.h"
+
+/*
+ * Out-of-core processing under a memory budget (wkt->budget).
+ *
+ * The input is streamed once, member by member, and each member is
+ * spilled to an unlinked scratch file in $TMPDIR as length prefixed
+ * WKB while only its bounding box is kept. The boxes are then sorted
+ * along the Hilbert curve and cut into batches whose WKB fits in a
+ * share of the budget, so every batch is a spatially compact piece of
+ * the input. Each batch is read back as one GEOMETRYCOLLECTION in
+ * wkt->geom and handed to the caller, together with the extent of the
+ * whole input.
+ *
+ * Resident memory is one batch plus 40 bytes of box per member.
+ */
+
+#define BATCH_SHARE 4 /* GEOS geometry is a few times its WKB size */
+#define LEAF_MIN 1024
+
+struct spill {
+    FILE *f;
+    GEOSWKBWriter *wkbw;
+    GEOSWKBReader *wkbr;
+    struct wkt_node *leaf;
+    size_t n;
+    size_t size;
+    uint64_t offset;
+    struct wkt_node extent;
+};
+
+static FILE *w_scratch(void)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    FILE *f = NULL;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/wktXXXXXX", dir ? dir : "/tmp");
+    fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    unlink(path); /* gone when closed */
+
+    f = fdopen(fd, "w+");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+    }
+
+    return f;
+}
+
+static int w_spill(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    const char *gtype,
+    void *user_data)
+{
+    struct spill *spill = user_data;
+    struct wkt_node *leaf;
+    unsigned char *wkb;
+    size_t size;
+    uint32_t len;
+    int err = 1;
+
+    (void)gtype;
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0; /* nothing to bound, hull or draw */
+    }
+
+    if (spill->n == spill->size) {
+        size_t grow = spill->size ? spill->size * 2 : LEAF_MIN;
+
+        leaf = realloc(spill->leaf, grow * sizeof(*leaf));
+        if (leaf == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        spill->leaf = leaf;
+        spill->size = grow;
+    }
+    leaf = &spill->leaf[spill->n];
+
+    if (!GEOSGeom_getExtent_r(wkt->handle, geom,
+                              &leaf->minx, &leaf->miny,
+                              &leaf->maxx, &leaf->maxy)) {
+        return 1;
+    }
+    leaf->offset = spill->offset;
+
+    wkb = GEOSWKBWriter_write_r(wkt->handle, spill->wkbw, geom, &size);
+    if (wkb == NULL) {
+        return 1;
+    }
+
+    do {
+        if (size > UINT32_MAX) {
+            fprintf(stderr, "Geometry too large to spill\n");
+            break;
+        }
+        len = size;
+        if (fwrite(&len, sizeof(len), 1, spill->f) != 1 ||
+            fwrite(wkb, size, 1, spill->f) != 1) {
+            fprintf(stderr, "Scratch file: %s\n", strerror(errno));
+            break;
+        }
+
+        if (spill->n == 0) {
+            spill->extent = *leaf;
+        } else {
+            wkt_rtree_expand(&spill->extent, leaf);
+        }
+        spill->offset += sizeof(len) + size;
+        spill->n++;
+        err = 0;
+    } while (0);
+
+    GEOSFree_r(wkt->handle, wkb);
+
+    return err;
+}
+
+static int w_pread(int fd, void *data, size_t len, uint64_t offset)
+{
+    ssize_t n;
+
+    while (len) {
+        n = pread(fd, data, len, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Scratch file: %s\n",
+                    n ? strerror(errno) : "truncated");
+            return 1;
+        }
+        data = (char *)data + n;
+        len -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+/* Read leaves from *next on until the batch is full; run the callback. */
+static int w_batch(
+    struct wkt *wkt,
+    struct spill *spill,
+    size_t *next,
+    wkt_batch_t batch,
+    void *user_data)
+{
+    int err = 0;
+    int fd = fileno(spill->f);
+    size_t limit = wkt->budget / BATCH_SHARE;
+    size_t bytes = 0;
+    size_t n = 0;
+    size_t size = 0;
+    size_t wkb_size = 0;
+    unsigned char *wkb = NULL;
+    GEOSGeometry **g = NULL;
+    GEOSGeometry *coll;
+    GEOSGeometry *save = wkt->geom;
+    uint32_t len;
+    size_t i;
+
+    /* always at least one member, however large */
+    while (!err && *next < spill->n && (n == 0 || bytes < limit)) {
+        uint64_t offset = spill->leaf[*next].offset;
+
+        err = w_pread(fd, &len, sizeof(len), offset);
+        if (err) {
+            break;
+        }
+        if (len > wkb_size) {
+            unsigned char *p = realloc(wkb, len);
+            if (p == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                err = 1;
+                break;
+            }
+            wkb = p;
+            wkb_size = len;
+        }
+        if (n == size) {
+            size_t grow = size ? size * 2 : LEAF_MIN;
+            GEOSGeometry **p = realloc(g, grow * sizeof(*p));
+            if (p == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                err = 1;
+                break;
+            }
+            g = p;
+            size = grow;
+        }
+
+        err = w_pread(fd, wkb, len, offset + sizeof(len));
+        if (!err) {
+            g[n] = GEOSWKBReader_read_r(wkt->handle, spill->wkbr, wkb, len);
+            err = (g[n] == NULL);
+        }
+        if (!err) {
+            n++;
+            bytes += sizeof(len) + len;
+            (*next)++;
+        }
+    }
+
+    free(wkb);
+
+    coll = NULL;
+    if (!err) {
+        coll = GEOSGeom_createCollection_r(
+            wkt->handle, GEOS_GEOMETRYCOLLECTION, g, n);
+        err = (coll == NULL);
+    }
+
+    if (coll) {
+        wkt->geom = coll;
+        err = batch(wkt, &spill->extent, user_data);
+        wkt->geom = save;
+        wkt_forget_bounds(wkt);
+        GEOSGeom_destroy_r(wkt->handle, coll);
+    } else {
+        for (i=0; i<n; i++) {
+            GEOSGeom_destroy_r(wkt->handle, g[i]);
+        }
+    }
+
+    free(g);
+
+    return err;
+}
+
+/*
+ * Run batch over the input a budget's worth at a time. With records
+ * set the input is one geometry per record as for wkt_stream(),
+ * otherwise it is a single WKT document split into its members.
+ */
+int wkt_batch(
+    struct wkt *wkt,
+    const char *file,
+    int records,
+    wkt_batch_t batch,
+    void *user_data)
+{
+    int err = 1;
+    struct spill spill;
+    size_t next = 0;
+
+    memset(&spill, 0, sizeof(spill));
+
+    do {
+        if (wkt->budget == 0) {
+            fprintf(stderr, "No memory budget set\n");
+            break;
+        }
+
+        spill.f = w_scratch();
+        spill.wkbw = GEOSWKBWriter_create_r(wkt->handle);
+        spill.wkbr = GEOSWKBReader_create_r(wkt->handle);
+        if (spill.f == NULL || spill.wkbw == NULL || spill.wkbr == NULL) {
+            break;
+        }
+
+        if (records) {
+            err = wkt_stream(wkt, file, w_spill, &spill);
+        } else {
+            err = wkt_stream_split(wkt, file, w_spill, &spill);
+        }
+        if (!err && fflush(spill.f)) {
+            fprintf(stderr, "Scratch file: %s\n", strerror(errno));
+            err = 1;
+        }
+        if (err) {
+            break;
+        }
+
+        /* spatially close members end up in the same batch */
+        err = wkt_rtree_sort(spill.leaf, spill.n);
+        if (err) {
+            break;
+        }
+
+        posix_fadvise(fileno(spill.f), 0, 0, POSIX_FADV_RANDOM);
+
+        while (!err && next < spill.n) {
+            err = w_batch(wkt, &spill, &next, batch, user_data);
+        }
+
+    } while (0);
+
+    if (spill.wkbw) {
+        GEOSWKBWriter_destroy_r(wkt->handle, spill.wkbw);
+    }
+    if (spill.wkbr) {
+        GEOSWKBReader_destroy_r(wkt->handle, spill.wkbr);
+    }
+    if (spill.f) {
+        fclose(spill.f);
+    }
+    free(spill.leaf);
+
+    return err;
+}
+
+/*
+ * Parse a byte count with an optional K, M, G or T suffix. Zero and
+ * negative counts, which strtoull() would wrap around, are refused.
+ */
+int wkt_parse_size(const char *arg, size_t *size)
+{
+    const char *p = arg;
+    char *endp;
+    unsigned long long v;
+    int shift = 0;
+
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+
+    errno = 0;
+    v = strtoull(arg, &endp, 0);
+    if (!errno && endp != arg) {
+        switch (toupper((unsigned char)*endp)) {
+        case 'T':
+            shift += 10;
+            /* fall through */
+        case 'G':
+            shift += 10;
+            /* fall through */
+        case 'M':
+            shift += 10;
+            /* fall through */
+        case 'K':
+            shift += 10;
+            endp++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (*p == '-' || errno || endp == arg || *endp != 0 || v == 0 ||
+        v > (SIZE_MAX >> shift)) {
+        fprintf(stderr, "Bad size %s\n", arg);
+        return 1;
+    }
+
+    *size = (size_t)v << shift;
+
+    return 0;
+}
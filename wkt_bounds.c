@@ -5,8 +5,40 @@
 
 */
 
+#include <math.h>
+#include <stdlib.h>
 #include "wkt.h"
 
+/*
+ * The envelope of the input is worked out once and kept in
+ * wkt->envelope until the document changes. Flat input takes one
+ * pass over the coordinate arrays; GEOS geometry already knows its
+ * envelope and hands it over in one call.
+ */
+static int w_box(struct wkt *wkt, struct wkt_node *box)
+{
+    const GEOSGeometry *geom;
+
+    box->minx = box->miny = HUGE_VAL;
+    box->maxx = box->maxy = -HUGE_VAL;
+    box->offset = 0;
+
+    if (wkt->geom == NULL && wkt->flat.n) {
+        /* no need to build geometry just for this */
+        wkt_minmax(wkt->flat.x, wkt->flat.y, wkt->flat.n, box);
+        return box->minx <= box->maxx;
+    }
+
+    geom = wkt_geometry(wkt);
+    if (geom == NULL) {
+        return 0;
+    }
+
+    return GEOSGeom_getExtent_r(wkt->handle, geom,
+                                &box->minx, &box->miny,
+                                &box->maxx, &box->maxy);
+}
+
 int wkt_bounds(
     struct wkt *wkt,
     double *xmin,
@@ -14,32 +46,41 @@ int wkt_bounds(
     double *ymin,
     double *ymax)
 {
-    int rc = 0;
+    struct wkt_node *box = &wkt->envelope.box;
 
-    do {
-        /* get bounds */
-        rc = GEOSGeom_getXMin_r(wkt->handle, wkt->geom, xmin);
-        if (!rc) {
-            break;
-        }
-
-        rc = GEOSGeom_getXMax_r(wkt->handle, wkt->geom, xmax);
-        if (!rc) {
-            break;
-        }
-
-        rc = GEOSGeom_getYMin_r(wkt->handle, wkt->geom, ymin);
-        if (!rc) {
-            break;
-        }
+    if (wkt->envelope.of != wkt->geom) {
+        wkt_forget_bounds(wkt);
+    }
 
-        rc = GEOSGeom_getYMax_r(wkt->handle, wkt->geom, ymax);
-        if (!rc) {
-            break;
+    if (!wkt->envelope.valid) {
+        if (!w_box(wkt, box)) {
+            return 0;
         }
+        /* building geometry from flat input moves the key */
+        wkt->envelope.of = wkt->geom;
+        wkt->envelope.valid = 1;
+    }
 
-    } while (0);
+    *xmin = box->minx;
+    *xmax = box->maxx;
+    *ymin = box->miny;
+    *ymax = box->maxy;
 
-    return rc;
+    return 1;
 }
 
+/*
+ * Drop cached envelopes. Needed whenever wkt->geom or the flat arrays
+ * are replaced other than through wkt_reset().
+ */
+void wkt_forget_bounds(struct wkt *wkt)
+{
+    free(wkt->envelope.feature);
+    wkt->envelope.feature = NULL;
+    wkt->envelope.n = 0;
+    free(wkt->envelope.tree);
+    wkt->envelope.tree = NULL;
+    wkt->envelope.leaves = 0;
+    wkt->envelope.valid = 0;
+    wkt->envelope.of = wkt->geom;
+}
@@ -0,0 +1,104 @@
+/*
+   wkt_bounds_z.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <math.h>
+#include "wkt.h"
+
+struct zrange {
+    double min;
+    double max;
+};
+
+/* Z at a fixed stride, one copy per layout; NaN never compares. */
+#define W_ZRANGE(name, stride)                                          \
+    static void name(struct zrange *r, const double *z, size_t n)       \
+    {                                                                   \
+        size_t i;                                                       \
+                                                                        \
+        for (i=0; i<n; i++, z += (stride)) {                            \
+            if (*z < r->min) {                                          \
+                r->min = *z;                                            \
+            }                                                           \
+            if (*z > r->max) {                                          \
+                r->max = *z;                                            \
+            }                                                           \
+        }                                                               \
+    }
+
+W_ZRANGE(w_zrange3, 3)
+W_ZRANGE(w_zrange4, 4)
+
+static int w_span(struct wkt *wkt, const struct wkt_span *span, void *user_data)
+{
+    (void)wkt;
+    if (span->z == NULL) {
+        return 0;
+    }
+    if (span->stride == 3) {
+        w_zrange3(user_data, span->z, span->n);
+    } else {
+        w_zrange4(user_data, span->z, span->n);
+    }
+
+    return 0;
+}
+
+static int w_visit(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    int type,
+    void *user_data)
+{
+    int err;
+    int n;
+    int i;
+
+    if (GEOSHasZ_r(wkt->handle, geom) != 1) {
+        return 0;
+    }
+    if (type != GEOS_POLYGON) {
+        return wkt_iterate_span(wkt, geom, w_span, user_data);
+    }
+
+    err = wkt_iterate_span(
+        wkt, GEOSGetExteriorRing_r(wkt->handle, geom), w_span, user_data);
+    n = GEOSGetNumInteriorRings_r(wkt->handle, geom);
+    for (i=0; !err && i<n; i++) {
+        err = wkt_iterate_span(
+            wkt, GEOSGetInteriorRingN_r(wkt->handle, geom, i),
+            w_span, user_data);
+    }
+
+    return err;
+}
+
+/*
+ * Z range of geom. Returns 1 if it has any Z values that are not NaN,
+ * the same sense as wkt_bounds(), else 0.
+ */
+int wkt_bounds_z(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    double *zmin,
+    double *zmax)
+{
+    struct zrange r;
+
+    r.min = HUGE_VAL;
+    r.max = -HUGE_VAL;
+
+    if (GEOSHasZ_r(wkt->handle, geom) != 1 ||
+        wkt_traverse(wkt, geom, w_visit, &r) ||
+        r.min > r.max) {
+        return 0;
+    }
+
+    *zmin = r.min;
+    *zmax = r.max;
+
+    return 1;
+}
@@ -5,6 +5,7 @@
 
 */
 
+#include <stdlib.h>
 #include "wkt.h"
 
 int wkt_close(struct wkt *wkt)
@@ -27,10 +28,15 @@ int wkt_close(struct wkt *wkt)
         GEOSWKBWriter_destroy_r(wkt->handle, wkt->wkbw);
     }
 
-    if (wkt->geom) {
-        GEOSGeom_destroy_r(wkt->handle, wkt->geom);
+    wkt_reset(wkt);
 
-    }
+    free(wkt->small);
+    wkt->small = NULL;
+    wkt->small_size = 0;
+
+    free(wkt->scratch);
+    wkt->scratch = NULL;
+    wkt->scratch_size = 0;
 
     GEOS_finish_r(wkt->handle);
 
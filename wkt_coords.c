@@ -0,0 +1,48 @@
+/*
+   wkt_coords.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+
+/*
+ * Flat single point input as one LineString through all the points,
+ * built from a single coordinate sequence, for GEOS operations that
+ * only use the coordinates (Delaunay, Voronoi, convex hull). This
+ * skips the Point per coordinate that wkt_geometry() has to make for
+ * a collection. The flat arrays are left alone.
+ *
+ * Returns NULL, without a message, for any other input, which then
+ * has to go through wkt_geometry(). The caller destroys the result.
+ * Building counts as reading.
+ */
+GEOSGeometry *wkt_coords(struct wkt *wkt)
+{
+    const struct wkt_flat *flat = &wkt->flat;
+    GEOSCoordSequence *seq;
+    GEOSGeometry *geom = NULL;
+    uint64_t start;
+
+    /* a LineString needs two points */
+    if (wkt->geom != NULL || flat->nodes != 0 || flat->n < 2 ||
+        flat->n > (unsigned int)-1) {
+        return NULL;
+    }
+
+    start = wkt_stats_begin(WKT_PHASE_READ);
+    seq = GEOSCoordSeq_copyFromArrays_r(
+        wkt->handle,
+        flat->x,
+        flat->y,
+        flat->z,
+        flat->m,
+        flat->n);
+    if (seq != NULL) {
+        geom = GEOSGeom_createLineString_r(wkt->handle, seq);
+    }
+    wkt_stats_phase(WKT_PHASE_READ, start);
+
+    return geom;
+}
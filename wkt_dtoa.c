@@ -0,0 +1,648 @@
+/*
+   wkt_dtoa.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "wkt.h"
+
+/*
+ * Double to decimal for the WKT writer.
+ *
+ * Without a precision the shortest digit string that reads back to
+ * the same double is produced, using Ryu (Ulf Adams, PLDI 2018). The
+ * 125 bit power of five tables Ryu needs are computed from their
+ * definitions on first use rather than shipped as constants. Where
+ * the compiler has no 128 bit integers, %.15g to %.17g are tried in
+ * turn instead.
+ *
+ * With a precision the value is rounded to that many decimal places,
+ * ties to even, and trailing zeros are trimmed as GEOS does.
+ *
+ * Plain decimal notation is used for magnitudes from 1e-6 up to 1e21,
+ * exponent notation outside that.
+ */
+
+#define FIXED_MIN (-6) /* decimal point positions using plain notation */
+#define FIXED_MAX 21
+#define MAX_EXACT 9007199254740992.0 /* 2^53 */
+#define MAX_PLACES 17
+#define MAX_SHORT 1000000000000000ULL /* 10^15, see w_exact() */
+#define MANTISSA_BITS 52
+#define EXPONENT_BITS 11
+#define BIAS 1023
+
+static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17,
+};
+
+/* Lay out digits d[0..n) times 10^exp10. */
+static size_t w_layout(int neg, const char *d, int n, int exp10, char *buf)
+{
+    char *p = buf;
+    int point = n + exp10; /* digits before the decimal point */
+    int i;
+
+    if (neg) {
+        *p++ = '-';
+    }
+
+    if (point > FIXED_MIN && point <= FIXED_MAX) {
+        if (point <= 0) {
+            *p++ = '0';
+            *p++ = '.';
+            for (i=point; i<0; i++) {
+                *p++ = '0';
+            }
+            memcpy(p, d, n);
+            p += n;
+        } else if (point >= n) {
+            memcpy(p, d, n);
+            p += n;
+            for (i=n; i<point; i++) {
+                *p++ = '0';
+            }
+        } else {
+            memcpy(p, d, point);
+            p += point;
+            *p++ = '.';
+            memcpy(p, d + point, n - point);
+            p += n - point;
+        }
+    } else {
+        *p++ = d[0];
+        if (n > 1) {
+            *p++ = '.';
+            memcpy(p, d + 1, n - 1);
+            p += n - 1;
+        }
+        p += sprintf(p, "e%+d", point - 1);
+    }
+
+    *p = 0;
+
+    return p - buf;
+}
+
+/* Decimal digits of m, most significant first; returns the count. */
+static int w_digits(uint64_t m, char *d)
+{
+    static const char pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    int n;
+
+    while (m >= 100) {
+        p -= 2;
+        memcpy(p, pairs + 2 * (m % 100), 2);
+        m /= 100;
+    }
+    if (m >= 10) {
+        p -= 2;
+        memcpy(p, pairs + 2 * m, 2);
+    } else {
+        *--p = '0' + m;
+    }
+
+    n = tmp + sizeof(tmp) - p;
+    memcpy(d, p, n);
+
+    return n;
+}
+
+/*
+ * A normal double m2 * 2^-f with few fraction bits is exactly the
+ * decimal m2 * 5^f * 10^-f. With 15 digits or fewer that is also the
+ * shortest form, since no two such decimals round to the same
+ * double; integers have no closer neighbour either. Returns 1 when
+ * the digits in *out, *e10 are found this way.
+ */
+static int w_exact(double v, uint64_t *out, int32_t *e10)
+{
+    static const uint64_t pow5_short[] = {
+        1ULL, 5ULL, 25ULL, 125ULL, 625ULL, 3125ULL, 15625ULL,
+        78125ULL, 390625ULL, 1953125ULL, 9765625ULL, 48828125ULL,
+        244140625ULL, 1220703125ULL, 6103515625ULL, 30517578125ULL,
+        152587890625ULL, 762939453125ULL, 3814697265625ULL,
+        19073486328125ULL, 95367431640625ULL, 476837158203125ULL,
+    };
+    uint64_t bits;
+    uint32_t exponent;
+    uint64_t m2;
+    int32_t f;
+    int shift;
+    uint64_t m;
+    int32_t e;
+
+    memcpy(&bits, &v, sizeof(bits));
+    exponent = (bits >> MANTISSA_BITS) & ((1u << EXPONENT_BITS) - 1);
+    f = BIAS + MANTISSA_BITS - (int32_t)exponent;
+    if (exponent == 0 || f < 0) {
+        return 0; /* subnormal, or at least 2^53 */
+    }
+
+    m2 = (((uint64_t)1) << MANTISSA_BITS) |
+        (bits & ((((uint64_t)1) << MANTISSA_BITS) - 1));
+    shift = __builtin_ctzll(m2);
+    if (shift > f) {
+        shift = f;
+    }
+    m2 >>= shift;
+    f -= shift;
+
+    if (f > 0 && (f >= (int32_t)(sizeof(pow5_short) / sizeof(pow5_short[0])) ||
+                  m2 >= MAX_SHORT / pow5_short[f])) {
+        return 0;
+    }
+
+    m = m2 * pow5_short[f];
+    e = -f;
+    while (m % 10 == 0) {
+        m /= 10;
+        e++;
+    }
+
+    *out = m;
+    *e10 = e;
+
+    return 1;
+}
+
+static size_t w_special(double v, char *buf)
+{
+    if (isnan(v)) {
+        return sprintf(buf, "NaN");
+    }
+
+    return sprintf(buf, signbit(v) ? "-Infinity" : "Infinity");
+}
+
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 uint128_t;
+
+#define POW5_BITS 125
+#define POW5_INV_COUNT 342
+#define POW5_COUNT 326
+#define BIG_LIMBS 14 /* 5^341 needs 793 bits */
+
+static uint64_t pow5_inv[POW5_INV_COUNT][2];
+static uint64_t pow5[POW5_COUNT][2];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static unsigned int w_bitlen(const uint64_t *big, size_t n)
+{
+    uint64_t top = big[n - 1];
+    unsigned int bits = 64 * (n - 1);
+
+    while (top) {
+        bits++;
+        top >>= 1;
+    }
+
+    return bits;
+}
+
+/* 128 bits of big starting at bit shift. */
+static uint128_t w_extract(const uint64_t *big, size_t n, unsigned int shift)
+{
+    uint128_t v = 0;
+    size_t limb = shift / 64;
+    unsigned int bit = shift % 64;
+    size_t i;
+
+    for (i=0; i<3 && limb + i < n; i++) {
+        uint128_t part = big[limb + i];
+
+        if (i == 0) {
+            v |= part >> bit;
+        } else if (64 * i >= bit) {
+            v |= part << (64 * i - bit);
+        }
+    }
+
+    return v;
+}
+
+static int w_big_ge(const uint64_t *a, const uint64_t *b, size_t n)
+{
+    size_t i = n;
+
+    while (i--) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i];
+        }
+    }
+
+    return 1;
+}
+
+static void w_big_sub(uint64_t *a, const uint64_t *b, size_t n)
+{
+    uint64_t borrow = 0;
+    size_t i;
+
+    for (i=0; i<n; i++) {
+        uint64_t bi = b[i] + borrow;
+        borrow = (bi < borrow) || (a[i] < bi);
+        a[i] -= bi;
+    }
+}
+
+static void w_big_shl1(uint64_t *a, size_t n)
+{
+    size_t i = n;
+
+    while (i-- > 1) {
+        a[i] = (a[i] << 1) | (a[i - 1] >> 63);
+    }
+    a[0] <<= 1;
+}
+
+/*
+ * pow5[i] is 5^i scaled to exactly POW5_BITS bits, pow5_inv[i] is
+ * floor(2^(bitlen(5^i) - 1 + POW5_BITS) / 5^i) + 1.
+ */
+static void w_tables(void)
+{
+    uint64_t big[BIG_LIMBS];
+    uint64_t rem[BIG_LIMBS + 1];
+    size_t n = 1;
+    unsigned int bits;
+    uint128_t v;
+    uint128_t q;
+    uint128_t carry;
+    size_t i;
+    size_t j;
+    int k;
+
+    memset(big, 0, sizeof(big));
+    big[0] = 1;
+
+    for (i=0; i<POW5_INV_COUNT; i++) {
+        bits = w_bitlen(big, n);
+
+        if (i < POW5_COUNT) {
+            if (bits >= POW5_BITS) {
+                v = w_extract(big, n, bits - POW5_BITS);
+                v &= (((uint128_t)1) << POW5_BITS) - 1;
+            } else {
+                v = w_extract(big, n, 0) << (POW5_BITS - bits);
+            }
+            pow5[i][0] = (uint64_t)v;
+            pow5[i][1] = (uint64_t)(v >> 64);
+        }
+
+        /*
+         * Long division of 2^(bits - 1 + POW5_BITS): the leading
+         * bits - 1 steps only shift, so start from 2^(bits - 1).
+         */
+        memset(rem, 0, sizeof(rem));
+        rem[(bits - 1) / 64] = ((uint64_t)1) << ((bits - 1) % 64);
+        q = 0;
+        for (k=POW5_BITS; k>=0; k--) {
+            q <<= 1;
+            if (w_big_ge(rem, big, BIG_LIMBS)) {
+                w_big_sub(rem, big, BIG_LIMBS);
+                q |= 1;
+            }
+            if (k) {
+                w_big_shl1(rem, BIG_LIMBS);
+            }
+        }
+        q += 1;
+        pow5_inv[i][0] = (uint64_t)q;
+        pow5_inv[i][1] = (uint64_t)(q >> 64);
+
+        /* next power */
+        carry = 0;
+        for (j=0; j<n; j++) {
+            carry += (uint128_t)big[j] * 5;
+            big[j] = (uint64_t)carry;
+            carry >>= 64;
+        }
+        if (carry) {
+            big[n++] = (uint64_t)carry;
+        }
+    }
+}
+
+static int32_t w_pow5bits(int32_t e)
+{
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+static uint32_t w_log10_pow2(int32_t e)
+{
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+static uint32_t w_log10_pow5(int32_t e)
+{
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+static uint32_t w_pow5_factor(uint64_t v)
+{
+    uint32_t count = 0;
+
+    while (v % 5 == 0) {
+        v /= 5;
+        count++;
+    }
+
+    return count;
+}
+
+static int w_multiple_pow5(uint64_t v, uint32_t p)
+{
+    return w_pow5_factor(v) >= p;
+}
+
+static int w_multiple_pow2(uint64_t v, uint32_t p)
+{
+    return (v & ((((uint64_t)1) << p) - 1)) == 0;
+}
+
+static uint64_t w_mul_shift(uint64_t m, const uint64_t *mul, int32_t j)
+{
+    uint128_t b0 = (uint128_t)m * mul[0];
+    uint128_t b2 = (uint128_t)m * mul[1];
+
+    return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+/* Shortest decimal m * 10^e that rounds to the double. */
+static void w_ryu(uint64_t mantissa, uint32_t exponent, uint64_t *out, int32_t *e10)
+{
+    int32_t e2;
+    uint64_t m2;
+    uint64_t mv;
+    uint32_t mm_shift;
+    int even;
+    uint64_t vr;
+    uint64_t vp;
+    uint64_t vm;
+    int32_t e;
+    int vm_zeros = 0;
+    int vr_zeros = 0;
+    int32_t removed = 0;
+    uint8_t last = 0;
+    uint64_t output;
+
+    if (exponent == 0) {
+        e2 = 1 - BIAS - MANTISSA_BITS - 2;
+        m2 = mantissa;
+    } else {
+        e2 = (int32_t)exponent - BIAS - MANTISSA_BITS - 2;
+        m2 = (((uint64_t)1) << MANTISSA_BITS) | mantissa;
+    }
+    even = (m2 & 1) == 0;
+    mv = 4 * m2;
+    mm_shift = (mantissa != 0 || exponent <= 1);
+
+    if (e2 >= 0) {
+        uint32_t q = w_log10_pow2(e2) - (e2 > 3);
+        int32_t k = POW5_BITS + w_pow5bits(q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+
+        e = q;
+        vr = w_mul_shift(4 * m2, pow5_inv[q], i);
+        vp = w_mul_shift(4 * m2 + 2, pow5_inv[q], i);
+        vm = w_mul_shift(4 * m2 - 1 - mm_shift, pow5_inv[q], i);
+        if (q <= 21) {
+            if (mv % 5 == 0) {
+                vr_zeros = w_multiple_pow5(mv, q);
+            } else if (even) {
+                vm_zeros = w_multiple_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= w_multiple_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        uint32_t q = w_log10_pow5(-e2) - (-e2 > 1);
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = w_pow5bits(i) - POW5_BITS;
+        int32_t j = (int32_t)q - k;
+
+        e = (int32_t)q + e2;
+        vr = w_mul_shift(4 * m2, pow5[i], j);
+        vp = w_mul_shift(4 * m2 + 2, pow5[i], j);
+        vm = w_mul_shift(4 * m2 - 1 - mm_shift, pow5[i], j);
+        if (q <= 1) {
+            vr_zeros = 1;
+            if (even) {
+                vm_zeros = (mm_shift == 1);
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vr_zeros = w_multiple_pow2(mv, q);
+        }
+    }
+
+    if (vm_zeros || vr_zeros) {
+        while (vp / 10 > vm / 10) {
+            vm_zeros &= (vm % 10 == 0);
+            vr_zeros &= (last == 0);
+            last = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_zeros) {
+            while (vm % 10 == 0) {
+                vr_zeros &= (last == 0);
+                last = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_zeros && last == 5 && vr % 2 == 0) {
+            last = 4; /* round to even */
+        }
+        output = vr + ((vr == vm && (!even || !vm_zeros)) || last >= 5);
+    } else {
+        int up = 0;
+
+        if (vp / 100 > vm / 100) {
+            up = (vr % 100 >= 50);
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            up = (vr % 10 >= 5);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || up);
+    }
+
+    *out = output;
+    *e10 = e + removed;
+}
+
+static size_t w_shortest(double v, char *buf)
+{
+    uint64_t bits;
+    uint64_t mantissa;
+    uint32_t exponent;
+    uint64_t m;
+    int32_t e10;
+    char d[24];
+    int n;
+
+    memcpy(&bits, &v, sizeof(bits));
+    mantissa = bits & ((((uint64_t)1) << MANTISSA_BITS) - 1);
+    exponent = (bits >> MANTISSA_BITS) & ((1u << EXPONENT_BITS) - 1);
+
+    if (exponent == (1u << EXPONENT_BITS) - 1) {
+        return w_special(v, buf);
+    }
+    if (exponent == 0 && mantissa == 0) {
+        return w_layout(signbit(v), "0", 1, 0, buf);
+    }
+
+    if (!w_exact(v, &m, &e10)) {
+        pthread_once(&tables_once, w_tables);
+        w_ryu(mantissa, exponent, &m, &e10);
+    }
+
+    n = w_digits(m, d);
+
+    return w_layout(signbit(v), d, n, e10, buf);
+}
+
+#else
+
+static size_t w_shortest(double v, char *buf)
+{
+    char tmp[WKT_DTOA_SIZE];
+    char d[24];
+    char *p;
+    int exp10;
+    int n = 0;
+    int precision;
+    uint64_t m;
+    int32_t e10;
+
+    if (!isfinite(v)) {
+        return w_special(v, buf);
+    }
+    if (v == 0) {
+        return w_layout(signbit(v), "0", 1, 0, buf);
+    }
+    if (w_exact(v, &m, &e10)) {
+        n = w_digits(m, d);
+        return w_layout(signbit(v), d, n, e10, buf);
+    }
+
+    for (precision=15; precision<17; precision++) {
+        snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, v);
+        if (strtod(tmp, NULL) == v) {
+            break;
+        }
+    }
+    snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, v);
+
+    /* d.ddde[+-]x into digits and exponent, dropping trailing zeros */
+    for (p=tmp; *p && *p != 'e'; p++) {
+        if (*p >= '0' && *p <= '9') {
+            d[n++] = *p;
+        }
+    }
+    exp10 = atoi(p + 1) - (n - 1);
+    while (n > 1 && d[n - 1] == '0') {
+        n--;
+        exp10++;
+    }
+
+    return w_layout(signbit(v), d, n, exp10, buf);
+}
+
+#endif
+
+/* Round to places decimals, ties to even, trimming trailing zeros. */
+static size_t w_fixed(double v, int places, char *buf)
+{
+    double a = fabs(v);
+    double s;
+    double err;
+    double t;
+    uint64_t m;
+    char d[24];
+    int n;
+
+    if (!isfinite(v)) {
+        return w_special(v, buf);
+    }
+
+    if (places > MAX_PLACES) {
+        places = MAX_PLACES;
+    }
+
+    s = a * pow10[places];
+    if (s >= MAX_EXACT) {
+        /* every digit that matters is before the decimal places */
+        return w_shortest(v, buf);
+    }
+
+    /* a * 10^places is exactly s + err */
+    err = fma(a, pow10[places], -s);
+    m = (uint64_t)s;
+    t = ((s - (double)m) - 0.5) + err;
+    if (t > 0 || (t == 0 && (m & 1))) {
+        m++;
+    }
+
+    if (m == 0) {
+        return w_layout(0, "0", 1, 0, buf);
+    }
+
+    while (places > 0 && m % 10 == 0) {
+        m /= 10;
+        places--;
+    }
+
+    n = w_digits(m, d);
+
+    return w_layout(signbit(v), d, n, -places, buf);
+}
+
+/*
+ * Format v into buf, which must hold WKT_DTOA_SIZE bytes; places < 0
+ * is shortest round trip. Returns the length.
+ */
+size_t wkt_dtoa(double v, int places, char *buf)
+{
+    if (places < 0) {
+        return w_shortest(v, buf);
+    }
+
+    return w_fixed(v, places, buf);
+}
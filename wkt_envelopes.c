@@ -0,0 +1,142 @@
+/*
+   wkt_envelopes.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "wkt.h"
+
+static void w_empty(struct wkt_node *box, size_t i)
+{
+    box->minx = box->miny = HUGE_VAL;
+    box->maxx = box->maxy = -HUGE_VAL;
+    box->offset = i;
+}
+
+static int w_collection(int type)
+{
+    return type == GEOS_MULTIPOINT ||
+        type == GEOS_MULTILINESTRING ||
+        type == GEOS_MULTIPOLYGON ||
+        type == GEOS_GEOMETRYCOLLECTION;
+}
+
+/* Flat input: one pass over each feature's run of coordinates. */
+static struct wkt_node *w_flat(const struct wkt_flat *flat, size_t *n)
+{
+    struct wkt_node *box;
+    size_t node = 0;
+    size_t from = 0;
+    size_t to = 0;
+    size_t i;
+
+    if (flat->nodes == 0) {
+        *n = flat->n;
+    } else if (w_collection(flat->node_type[0])) {
+        *n = flat->node_count[0];
+        node = 1;
+    } else {
+        *n = 1;
+    }
+
+    box = malloc((*n ? *n : 1) * sizeof(*box));
+    if (box == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (i=0; i<*n; i++) {
+        w_empty(&box[i], i);
+        if (flat->nodes == 0) {
+            to = from + 1;
+        } else if (wkt_flat_subtree(flat, &node, &to)) {
+            free(box);
+            return NULL;
+        }
+        wkt_minmax(flat->x + from, flat->y + from, to - from, &box[i]);
+        from = to;
+    }
+
+    return box;
+}
+
+static struct wkt_node *w_geom(struct wkt *wkt, size_t *n)
+{
+    struct wkt_node *box;
+    const GEOSGeometry *top;
+    const GEOSGeometry *geom;
+    int count;
+    size_t i;
+
+    top = wkt_geometry(wkt);
+    if (top == NULL) {
+        return NULL;
+    }
+
+    count = GEOSGetNumGeometries_r(wkt->handle, top);
+    if (count < 0) {
+        return NULL;
+    }
+    *n = count;
+    box = malloc((*n ? *n : 1) * sizeof(*box));
+    if (box == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (i=0; i<*n; i++) {
+        w_empty(&box[i], i);
+        geom = GEOSGetGeometryN_r(wkt->handle, top, i);
+        if (geom == NULL) {
+            free(box);
+            return NULL;
+        }
+        if (!GEOSisEmpty_r(wkt->handle, geom) &&
+            !GEOSGeom_getExtent_r(wkt->handle, geom,
+                                  &box[i].minx, &box[i].miny,
+                                  &box[i].maxx, &box[i].maxy)) {
+            free(box);
+            return NULL;
+        }
+    }
+
+    return box;
+}
+
+/*
+ * Envelopes of the top level features, in the order wkt_iterate()
+ * visits them, with the feature's index as the offset. An empty
+ * feature has an empty box (minx > maxx). They are worked out on
+ * first use and kept until the document changes; n is set to their
+ * number. NULL on failure.
+ */
+const struct wkt_node *wkt_envelopes(struct wkt *wkt, size_t *n)
+{
+    struct wkt_node *box;
+
+    if (wkt->envelope.of != wkt->geom) {
+        wkt_forget_bounds(wkt);
+    }
+
+    if (wkt->envelope.feature == NULL) {
+        if (wkt->geom == NULL && (wkt->flat.n || wkt->flat.nodes)) {
+            box = w_flat(&wkt->flat, n);
+        } else {
+            box = w_geom(wkt, n);
+        }
+        if (box == NULL) {
+            return NULL;
+        }
+        wkt->envelope.of = wkt->geom;
+        wkt->envelope.feature = box;
+        wkt->envelope.n = *n;
+    }
+
+    *n = wkt->envelope.n;
+
+    return wkt->envelope.feature;
+}
@@ -0,0 +1,513 @@
+/*
+   wkt_feed.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <lzma.h>
+#include "wkt.h"
+
+/*
+ * Input that cannot simply be mapped: a decompressor thread reads the
+ * descriptor and pushes decoded bytes into a bounded ring which the
+ * parser drains with wkt_feed_read(), so decompression overlaps
+ * parsing and never needs a temporary file. Uncompressed pipes and
+ * terminals are read directly without a thread.
+ *
+ * Bytes already read to sniff the magic number are kept in 'in' and
+ * returned before anything else is read from the descriptor.
+ */
+
+#define FEED_RING (4*1024*1024)
+#define FEED_CHUNK (64*1024)
+#define FEED_SLURP (1024*1024)
+
+struct wkt_feed {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int fd;
+    wkt_z_t z;
+    const char *name;
+    char *ring;
+    size_t size;
+    size_t head; /* total bytes produced */
+    size_t tail; /* total bytes consumed */
+    int threaded;
+    int done;
+    int failed;
+    int stop;
+    size_t pending;
+    size_t pending_at;
+    unsigned char in[FEED_CHUNK];
+    unsigned char out[FEED_CHUNK];
+};
+
+/* Push decoded bytes into the ring, waiting for room. */
+static int w_put(struct wkt_feed *feed, const unsigned char *data, size_t len)
+{
+    size_t n;
+    size_t at;
+
+    pthread_mutex_lock(&feed->lock);
+    while (len > 0 && !feed->stop) {
+        while (feed->head - feed->tail == feed->size && !feed->stop) {
+            pthread_cond_wait(&feed->cond, &feed->lock);
+        }
+        at = feed->head % feed->size;
+        n = feed->size - (feed->head - feed->tail);
+        if (n > feed->size - at) {
+            n = feed->size - at;
+        }
+        if (n > len) {
+            n = len;
+        }
+        memcpy(feed->ring + at, data, n);
+        feed->head += n;
+        data += n;
+        len -= n;
+        pthread_cond_broadcast(&feed->cond);
+    }
+    n = feed->stop;
+    pthread_mutex_unlock(&feed->lock);
+
+    return !n;
+}
+
+/* Read raw input; returns bytes read, 0 at EOF, -1 on error. */
+static ssize_t w_get(struct wkt_feed *feed)
+{
+    ssize_t n;
+
+    if (feed->pending) {
+        n = feed->pending;
+        feed->pending = 0;
+        return n;
+    }
+
+    do {
+        n = read(feed->fd, feed->in, sizeof(feed->in));
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        fprintf(stderr, "%s: %s\n", feed->name, strerror(errno));
+    }
+
+    return n;
+}
+
+static int w_gzip(struct wkt_feed *feed)
+{
+    int err = 1;
+    int rc = Z_OK;
+    ssize_t n;
+    z_stream z;
+
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "%s: %s\n", feed->name, "inflateInit failed");
+        return err;
+    }
+
+    while ((n = w_get(feed)) > 0) {
+        z.next_in = feed->in;
+        z.avail_in = n;
+        do {
+            if (rc == Z_STREAM_END) {
+                if (z.avail_in == 0) {
+                    break;
+                }
+                /* concatenated gzip members */
+                inflateReset(&z);
+            }
+            z.next_out = feed->out;
+            z.avail_out = sizeof(feed->out);
+            rc = inflate(&z, Z_NO_FLUSH);
+            if (rc == Z_BUF_ERROR) {
+                rc = Z_OK; /* needs more input */
+            } else if (rc != Z_OK && rc != Z_STREAM_END) {
+                fprintf(stderr, "%s: %s\n", feed->name,
+                        z.msg ? z.msg : "inflate failed");
+                n = -1;
+                break;
+            }
+            if (!w_put(feed, feed->out, sizeof(feed->out) - z.avail_out)) {
+                n = -1;
+                break;
+            }
+        } while (z.avail_in > 0 || z.avail_out == 0);
+        if (n < 0) {
+            break;
+        }
+    }
+
+    if (n == 0) {
+        err = (rc != Z_STREAM_END);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", feed->name, "truncated gzip data");
+        }
+    }
+
+    inflateEnd(&z);
+
+    return err;
+}
+
+static int w_zstd(struct wkt_feed *feed)
+{
+    int err = 1;
+    size_t rc = 0;
+    ssize_t n;
+    ZSTD_DStream *z;
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+
+    z = ZSTD_createDStream();
+    if (z == NULL) {
+        fprintf(stderr, "%s: %s\n", feed->name, "ZSTD_createDStream failed");
+        return err;
+    }
+    ZSTD_initDStream(z);
+
+    while ((n = w_get(feed)) > 0) {
+        in.src = feed->in;
+        in.size = n;
+        in.pos = 0;
+        do {
+            out.dst = feed->out;
+            out.size = sizeof(feed->out);
+            out.pos = 0;
+            rc = ZSTD_decompressStream(z, &out, &in);
+            if (ZSTD_isError(rc)) {
+                fprintf(stderr, "%s: %s\n", feed->name,
+                        ZSTD_getErrorName(rc));
+                n = -1;
+                break;
+            }
+            if (!w_put(feed, feed->out, out.pos)) {
+                n = -1;
+                break;
+            }
+        } while (in.pos < in.size || out.pos == out.size);
+        if (n < 0) {
+            break;
+        }
+    }
+
+    if (n == 0) {
+        /* rc is 0 when the last frame was completely decoded */
+        err = (rc != 0);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", feed->name, "truncated zstd data");
+        }
+    }
+
+    ZSTD_freeDStream(z);
+
+    return err;
+}
+
+static int w_xz(struct wkt_feed *feed)
+{
+    int err = 1;
+    ssize_t n = 1;
+    lzma_ret rc = LZMA_OK;
+    lzma_action action = LZMA_RUN;
+    lzma_stream z = LZMA_STREAM_INIT;
+
+    if (lzma_stream_decoder(&z, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        fprintf(stderr, "%s: %s\n", feed->name, "lzma_stream_decoder failed");
+        return err;
+    }
+
+    while (rc == LZMA_OK) {
+        if (z.avail_in == 0 && action == LZMA_RUN) {
+            n = w_get(feed);
+            if (n < 0) {
+                break;
+            }
+            if (n == 0) {
+                action = LZMA_FINISH;
+            }
+            z.next_in = feed->in;
+            z.avail_in = n;
+        }
+        z.next_out = feed->out;
+        z.avail_out = sizeof(feed->out);
+        rc = lzma_code(&z, action);
+        if (!w_put(feed, feed->out, sizeof(feed->out) - z.avail_out)) {
+            n = -1;
+            break;
+        }
+    }
+
+    if (n >= 0) {
+        err = (rc != LZMA_STREAM_END);
+        if (err) {
+            fprintf(stderr, "%s: %s %d\n", feed->name, "xz error", rc);
+        }
+    }
+
+    lzma_end(&z);
+
+    return err;
+}
+
+static void *w_worker(void *arg)
+{
+    struct wkt_feed *feed = arg;
+    int err;
+
+    switch (feed->z) {
+    case WKT_Z_GZIP:
+        err = w_gzip(feed);
+        break;
+    case WKT_Z_ZSTD:
+        err = w_zstd(feed);
+        break;
+    case WKT_Z_XZ:
+        err = w_xz(feed);
+        break;
+    default:
+        err = 1;
+        break;
+    }
+
+    pthread_mutex_lock(&feed->lock);
+    feed->done = 1;
+    feed->failed = err;
+    pthread_cond_broadcast(&feed->cond);
+    pthread_mutex_unlock(&feed->lock);
+
+    return NULL;
+}
+
+/* Identify compressed input by its magic bytes. */
+wkt_z_t wkt_feed_detect(const unsigned char *magic, size_t len)
+{
+    static const unsigned char gzip[] = { 0x1f, 0x8b };
+    static const unsigned char zstd[] = { 0x28, 0xb5, 0x2f, 0xfd };
+    static const unsigned char xz[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+
+    if (len >= sizeof(gzip) && !memcmp(magic, gzip, sizeof(gzip))) {
+        return WKT_Z_GZIP;
+    }
+    if (len >= sizeof(zstd) && !memcmp(magic, zstd, sizeof(zstd))) {
+        return WKT_Z_ZSTD;
+    }
+    if (len >= sizeof(xz) && !memcmp(magic, xz, sizeof(xz))) {
+        return WKT_Z_XZ;
+    }
+
+    return WKT_Z_NONE;
+}
+
+/*
+ * Start decoding fd, which the feed takes ownership of. The first len
+ * bytes of input have already been read into prefix.
+ */
+int wkt_feed_open(
+    struct wkt *wkt,
+    int fd,
+    wkt_z_t z,
+    const unsigned char *prefix,
+    size_t len,
+    const char *name)
+{
+    int err = 1;
+    struct wkt_feed *feed;
+
+    do {
+        feed = calloc(1, sizeof(*feed));
+        if (feed == NULL) {
+            break;
+        }
+
+        feed->fd = fd;
+        feed->z = z;
+        feed->name = name;
+        if (len) {
+            memcpy(feed->in, prefix, len);
+            feed->pending = len;
+        }
+
+        if (z == WKT_Z_NONE) {
+            wkt->feed = feed;
+            err = 0;
+            break;
+        }
+
+        feed->size = FEED_RING;
+        feed->ring = malloc(feed->size);
+        if (feed->ring == NULL) {
+            free(feed);
+            break;
+        }
+
+        pthread_mutex_init(&feed->lock, NULL);
+        pthread_cond_init(&feed->cond, NULL);
+
+        if (pthread_create(&feed->thread, NULL, w_worker, feed)) {
+            pthread_cond_destroy(&feed->cond);
+            pthread_mutex_destroy(&feed->lock);
+            free(feed->ring);
+            free(feed);
+            break;
+        }
+
+        feed->threaded = 1;
+        wkt->feed = feed;
+        err = 0;
+
+    } while (0);
+
+    if (err) {
+        fprintf(stderr, "%s: %s\n", name, "Could not start decoder");
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+    }
+
+    return err;
+}
+
+/*
+ * Copy up to len decoded bytes into data, waiting until at least one
+ * is available. Returns the count, 0 at end of input, -1 on error.
+ */
+ssize_t wkt_feed_read(struct wkt *wkt, char *data, size_t len)
+{
+    struct wkt_feed *feed = wkt->feed;
+    ssize_t ret = 0;
+    size_t n;
+    size_t at;
+
+    if (!feed->threaded) {
+        if (feed->pending) {
+            n = (feed->pending < len) ? feed->pending : len;
+            memcpy(data, feed->in + feed->pending_at, n);
+            feed->pending -= n;
+            feed->pending_at += n;
+            wkt_stats_count(WKT_STAT_BYTES_READ, n);
+            return n;
+        }
+        do {
+            ret = read(feed->fd, data, len);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            fprintf(stderr, "%s: %s\n", feed->name, strerror(errno));
+        } else {
+            wkt_stats_count(WKT_STAT_BYTES_READ, ret);
+        }
+        return ret;
+    }
+
+    pthread_mutex_lock(&feed->lock);
+    while (feed->head == feed->tail && !feed->done) {
+        pthread_cond_wait(&feed->cond, &feed->lock);
+    }
+
+    if (feed->head != feed->tail) {
+        at = feed->tail % feed->size;
+        n = feed->head - feed->tail;
+        if (n > feed->size - at) {
+            n = feed->size - at;
+        }
+        if (n > len) {
+            n = len;
+        }
+        memcpy(data, feed->ring + at, n);
+        feed->tail += n;
+        ret = n;
+        wkt_stats_count(WKT_STAT_BYTES_READ, n);
+        pthread_cond_broadcast(&feed->cond);
+    } else if (feed->failed) {
+        ret = -1;
+    }
+    pthread_mutex_unlock(&feed->lock);
+
+    return ret;
+}
+
+/*
+ * Read the rest of the feed into one NUL terminated buffer for the
+ * whole-document readers, which own it as wkt->buffer.
+ */
+int wkt_feed_slurp(struct wkt *wkt)
+{
+    int err = 1;
+    char *buf = NULL;
+    char *t;
+    size_t size = 0;
+    size_t len = 0;
+    ssize_t n;
+
+    for (;;) {
+        if (size - len < FEED_CHUNK + 1) {
+            size = size ? size * 2 : FEED_SLURP;
+            t = realloc(buf, size);
+            if (t == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                break;
+            }
+            buf = t;
+        }
+
+        n = wkt_feed_read(wkt, buf + len, size - len - 1);
+        if (n <= 0) {
+            err = (n < 0);
+            break;
+        }
+        len += n;
+    }
+
+    if (!err) {
+        buf[len] = 0;
+        wkt->buffer = buf;
+        wkt->input = buf;
+        wkt->input_len = len;
+    } else {
+        free(buf);
+    }
+
+    return err;
+}
+
+void wkt_feed_close(struct wkt *wkt)
+{
+    struct wkt_feed *feed = wkt->feed;
+
+    if (feed == NULL) {
+        return;
+    }
+
+    if (feed->threaded) {
+        /* unblock the decoder if the consumer quit early */
+        pthread_mutex_lock(&feed->lock);
+        feed->stop = 1;
+        pthread_cond_broadcast(&feed->cond);
+        pthread_mutex_unlock(&feed->lock);
+
+        pthread_join(feed->thread, NULL);
+
+        pthread_cond_destroy(&feed->cond);
+        pthread_mutex_destroy(&feed->lock);
+        free(feed->ring);
+    }
+
+    if (feed->fd != STDIN_FILENO) {
+        close(feed->fd);
+    }
+    free(feed);
+
+    wkt->feed = NULL;
+}
@@ -0,0 +1,1398 @@
+/*
+   wkt_fgb.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "wkt.h"
+
+/*
+ * FlatGeobuf reader and writer. Only geometry is carried; there are
+ * no attribute columns. Z and M go in their own vectors beside xy when
+ * the geometry has them. Top level members become features, written
+ * in Hilbert order behind a packed R-tree.
+ *
+ * The header and feature tables are FlatBuffers. Rather than pull in
+ * the FlatBuffers runtime, the few tables needed are written by hand
+ * (vtable first, then the table, then whatever it refers to, so that
+ * every offset points forward) and read with bounds checked accessors.
+ * Values are copied in and out with memcpy, which makes the byte order
+ * that of the host; both directions refuse to run on big-endian hosts.
+ */
+
+/* GeometryType */
+enum {
+    FGB_UNKNOWN,
+    FGB_POINT,
+    FGB_LINESTRING,
+    FGB_POLYGON,
+    FGB_MULTIPOINT,
+    FGB_MULTILINESTRING,
+    FGB_MULTIPOLYGON,
+    FGB_COLLECTION,
+};
+
+/* Header fields */
+#define H_ENVELOPE 1
+#define H_GEOMETRY_TYPE 2
+#define H_HAS_Z 3
+#define H_HAS_M 4
+#define H_FEATURES_COUNT 8
+#define H_INDEX_NODE_SIZE 9
+#define H_FIELDS 10
+
+/* Feature fields */
+#define F_GEOMETRY 0
+#define F_FIELDS 1
+
+/* Geometry fields */
+#define G_ENDS 0
+#define G_XY 1
+#define G_Z 2
+#define G_M 3
+#define G_TYPE 6
+#define G_PARTS 7
+#define G_FIELDS 8
+
+#define MAGIC_LEN 8
+#define CHECK_LEN 7 /* ignore the patch level */
+#define BUILDER_MIN (64*1024)
+
+struct builder {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+    size_t base; /* alignment is relative to here */
+    int err;
+};
+
+struct coords {
+    double *xy;
+    size_t n; /* doubles */
+    size_t size;
+    int has_z;
+    int has_m;
+    double *z; /* n / 2 of each, if has_z or has_m */
+    double *m;
+    size_t zm_size;
+    uint32_t *ends;
+    size_t nends;
+    size_t ends_size;
+};
+
+/* One size prefixed FlatBuffer, not counting the prefix. */
+struct fbr {
+    const unsigned char *buf;
+    size_t len;
+};
+
+/* Coordinate vectors of a Geometry table, z and m 0 if absent. */
+struct vectors {
+    size_t xy;
+    size_t z;
+    size_t m;
+};
+
+struct fgb {
+    const unsigned char *data;
+    size_t len;
+    uint8_t type;
+    uint64_t count;
+    uint16_t node_size;
+    size_t index;
+    size_t features;
+};
+
+struct gather {
+    struct wkt *wkt;
+    const struct fgb *fgb;
+    GEOSGeometry **geom;
+    size_t n;
+    size_t size;
+};
+
+static int w_little_endian(void)
+{
+    const uint16_t one = 1;
+
+    if (*(const unsigned char *)&one) {
+        return 1;
+    }
+
+    fprintf(stderr, "FlatGeobuf needs a little-endian host\n");
+
+    return 0;
+}
+
+/*
+ * Writer
+ */
+
+/* Append n bytes, or zeros if p is NULL. Returns where they went. */
+static size_t b_add(struct builder *b, const void *p, size_t n)
+{
+    size_t at = b->len;
+
+    if (b->err) {
+        return at;
+    }
+
+    if (b->len + n > b->size) {
+        size_t size = b->size ? b->size : BUILDER_MIN;
+        unsigned char *data;
+
+        while (size < b->len + n) {
+            size *= 2;
+        }
+        data = realloc(b->data, size);
+        if (data == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            b->err = 1;
+            return at;
+        }
+        b->data = data;
+        b->size = size;
+    }
+
+    if (p) {
+        memcpy(b->data + at, p, n);
+    } else {
+        memset(b->data + at, 0, n);
+    }
+    b->len += n;
+
+    return at;
+}
+
+static void b_put(struct builder *b, size_t at, const void *p, size_t n)
+{
+    if (!b->err) {
+        memcpy(b->data + at, p, n);
+    }
+}
+
+/* Pad so that the next byte after skip more is aligned. */
+static void b_align(struct builder *b, size_t align, size_t skip)
+{
+    b_add(b, NULL, (align - ((b->len - b->base + skip) % align)) % align);
+}
+
+/* Point the offset field at 'at' forward to 'to'. */
+static void b_ref(struct builder *b, size_t at, size_t to)
+{
+    uint32_t v = to - at;
+
+    b_put(b, at, &v, sizeof(v));
+}
+
+/*
+ * Add a vtable and a zeroed table of size bytes whose fields live at
+ * the given offsets (0 for absent). Returns the table position.
+ */
+static size_t b_table(
+    struct builder *b,
+    const uint16_t *field,
+    uint16_t nfields,
+    uint16_t size,
+    size_t align)
+{
+    uint16_t vt_size = 4 + 2 * nfields;
+    size_t vt;
+    size_t table;
+    int32_t soffset;
+
+    b_align(b, 2, 0);
+    vt = b_add(b, &vt_size, sizeof(vt_size));
+    b_add(b, &size, sizeof(size));
+    b_add(b, field, nfields * sizeof(*field));
+
+    b_align(b, align, 0);
+    table = b->len;
+    soffset = table - vt;
+    b_add(b, &soffset, sizeof(soffset));
+    b_add(b, NULL, size - sizeof(soffset));
+
+    return table;
+}
+
+/* Add a vector of n elements, zeroed if p is NULL. */
+static size_t b_vector(
+    struct builder *b,
+    uint32_t n,
+    const void *p,
+    size_t elem)
+{
+    size_t at;
+
+    b_align(b, elem > 4 ? elem : 4, sizeof(n));
+    at = b_add(b, &n, sizeof(n));
+    b_add(b, p, n * elem);
+
+    return at;
+}
+
+/*
+ * Start a size prefixed buffer; returns the root offset position.
+ * Readers check alignment from the start of the buffer proper, just
+ * past the size.
+ */
+static size_t b_begin(struct builder *b)
+{
+    b_add(b, NULL, sizeof(uint32_t));
+    b->base = b_add(b, NULL, sizeof(uint32_t));
+
+    return b->base;
+}
+
+/*
+ * Fill in the size, padding so that the buffer after the next size
+ * prefix starts 8 byte aligned in the file. Features then line up in
+ * a mapped file too.
+ */
+static void b_end(struct builder *b, size_t root)
+{
+    uint32_t size;
+
+    b->base = 0;
+    b_align(b, 8, sizeof(size));
+    size = b->len - root;
+    b_put(b, root - sizeof(size), &size, sizeof(size));
+}
+
+static int w_type(int type)
+{
+    switch (type) {
+    case GEOS_POINT:
+        return FGB_POINT;
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        return FGB_LINESTRING;
+    case GEOS_POLYGON:
+        return FGB_POLYGON;
+    case GEOS_MULTIPOINT:
+        return FGB_MULTIPOINT;
+    case GEOS_MULTILINESTRING:
+        return FGB_MULTILINESTRING;
+    case GEOS_MULTIPOLYGON:
+        return FGB_MULTIPOLYGON;
+    case GEOS_GEOMETRYCOLLECTION:
+        return FGB_COLLECTION;
+    default:
+        break;
+    }
+
+    return FGB_UNKNOWN;
+}
+
+/* Make room for n coordinates in the z and m arrays. */
+static int w_zm(struct coords *c, size_t n)
+{
+    size_t size = c->zm_size ? c->zm_size : 512;
+    double *z;
+    double *m;
+
+    if (n <= c->zm_size) {
+        return 0;
+    }
+
+    while (size < n) {
+        size *= 2;
+    }
+    z = realloc(c->z, size * sizeof(*z));
+    if (z != NULL) {
+        c->z = z;
+    }
+    m = realloc(c->m, size * sizeof(*m));
+    if (m != NULL) {
+        c->m = m;
+    }
+    if (z == NULL || m == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    c->zm_size = size;
+
+    return 0;
+}
+
+/*
+ * Append a coordinate sequence to the interleaved xy array, and to the
+ * z and m arrays if the geometry has them. Sequences without a Z or M
+ * that the geometry has get NaN there.
+ */
+static int w_seq(struct wkt *wkt, struct coords *c, const GEOSGeometry *geom)
+{
+    const GEOSCoordSequence *seq;
+    unsigned int n;
+    unsigned int i;
+    unsigned int stride = 2 + c->has_z + c->has_m;
+    size_t at = c->n / 2;
+    double *buf;
+
+    seq = GEOSGeom_getCoordSeq_r(wkt->handle, geom);
+    if (seq == NULL || !GEOSCoordSeq_getSize_r(wkt->handle, seq, &n)) {
+        return 1;
+    }
+
+    if (c->n + 2 * n > c->size) {
+        size_t size = c->size ? c->size : 1024;
+        double *xy;
+
+        while (size < c->n + 2 * n) {
+            size *= 2;
+        }
+        xy = realloc(c->xy, size * sizeof(*xy));
+        if (xy == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        c->xy = xy;
+        c->size = size;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+
+    if (stride == 2) {
+        if (!GEOSCoordSeq_copyToBuffer_r(
+                wkt->handle, seq, c->xy + c->n, 0, 0)) {
+            return 1;
+        }
+        c->n += 2 * n;
+        return 0;
+    }
+
+    buf = wkt_scratch(wkt, (size_t)n * stride);
+    if (buf == NULL || w_zm(c, at + n) ||
+        !GEOSCoordSeq_copyToBuffer_r(
+            wkt->handle, seq, buf, c->has_z, c->has_m)) {
+        return 1;
+    }
+    for (i=0; i<n; i++, buf += stride) {
+        c->xy[c->n++] = buf[0];
+        c->xy[c->n++] = buf[1];
+        if (c->has_z) {
+            c->z[at + i] = buf[2];
+        }
+        if (c->has_m) {
+            c->m[at + i] = buf[2 + c->has_z];
+        }
+    }
+
+    return 0;
+}
+
+/* Close a part or ring at the current coordinate. */
+static int w_end(struct coords *c)
+{
+    if (c->nends == c->ends_size) {
+        size_t size = c->ends_size ? c->ends_size * 2 : 64;
+        uint32_t *ends = realloc(c->ends, size * sizeof(*ends));
+
+        if (ends == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        c->ends = ends;
+        c->ends_size = size;
+    }
+
+    c->ends[c->nends++] = c->n / 2;
+
+    return 0;
+}
+
+static int w_polygon(struct wkt *wkt, struct coords *c, const GEOSGeometry *geom)
+{
+    int err;
+    int n;
+    int i;
+
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0;
+    }
+
+    err = w_seq(wkt, c, GEOSGetExteriorRing_r(wkt->handle, geom));
+    if (!err) {
+        err = w_end(c);
+    }
+
+    n = GEOSGetNumInteriorRings_r(wkt->handle, geom);
+    if (n < 0) {
+        err = 1;
+    }
+
+    for (i=0; !err && i<n; i++) {
+        err = w_seq(wkt, c, GEOSGetInteriorRingN_r(wkt->handle, geom, i));
+        if (!err) {
+            err = w_end(c);
+        }
+    }
+
+    return err;
+}
+
+/*
+ * Add a Geometry table. Coordinates are gathered into the shared
+ * scratch arrays and written out before any parts are visited.
+ */
+static int w_geometry(
+    struct wkt *wkt,
+    struct builder *b,
+    struct coords *c,
+    const GEOSGeometry *geom,
+    size_t *table)
+{
+    uint16_t field[G_FIELDS] = { 4, 8, 20, 24, 0, 0, 16, 12 };
+    int err = 0;
+    int type;
+    int parts = 0;
+    int n;
+    int i;
+    uint8_t ftype;
+    size_t at;
+
+    if (geom == NULL) {
+        return 1;
+    }
+
+    type = GEOSGeomTypeId_r(wkt->handle, geom);
+    ftype = w_type(type);
+    c->n = 0;
+    c->nends = 0;
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        err = w_seq(wkt, c, geom);
+        break;
+    case GEOS_POLYGON:
+        err = w_polygon(wkt, c, geom);
+        break;
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+        n = GEOSGetNumGeometries_r(wkt->handle, geom);
+        err = (n < 0);
+        for (i=0; !err && i<n; i++) {
+            err = w_seq(wkt, c, GEOSGetGeometryN_r(wkt->handle, geom, i));
+            if (!err && type == GEOS_MULTILINESTRING) {
+                err = w_end(c);
+            }
+        }
+        break;
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        parts = GEOSGetNumGeometries_r(wkt->handle, geom);
+        err = (parts < 0);
+        break;
+    default:
+        fprintf(stderr, "Unsupported geometry type %d\n", type);
+        err = 1;
+        break;
+    }
+
+    if (err) {
+        return err;
+    }
+
+    /* absent fields must not appear in the vtable */
+    if (c->nends < 2) {
+        field[G_ENDS] = 0;
+    }
+    if (c->n == 0) {
+        field[G_XY] = 0;
+    }
+    if (c->n == 0 || !c->has_z) {
+        field[G_Z] = 0;
+    }
+    if (c->n == 0 || !c->has_m) {
+        field[G_M] = 0;
+    }
+    if (parts <= 0) {
+        field[G_PARTS] = 0;
+    }
+
+    *table = b_table(
+        b, field, G_FIELDS, (field[G_Z] || field[G_M]) ? 28 : 20, 4);
+    b_put(b, *table + 16, &ftype, sizeof(ftype));
+
+    if (c->n) {
+        at = b_vector(b, c->n, c->xy, sizeof(*c->xy));
+        b_ref(b, *table + 8, at);
+    }
+    if (field[G_Z]) {
+        at = b_vector(b, c->n / 2, c->z, sizeof(*c->z));
+        b_ref(b, *table + 20, at);
+    }
+    if (field[G_M]) {
+        at = b_vector(b, c->n / 2, c->m, sizeof(*c->m));
+        b_ref(b, *table + 24, at);
+    }
+
+    /* a single part or ring needs no ends */
+    if (c->nends > 1) {
+        at = b_vector(b, c->nends, c->ends, sizeof(*c->ends));
+        b_ref(b, *table + 4, at);
+    }
+
+    if (parts > 0) {
+        at = b_vector(b, parts, NULL, sizeof(uint32_t));
+        b_ref(b, *table + 12, at);
+        for (i=0; !err && i<parts; i++) {
+            size_t part;
+
+            err = w_geometry(
+                wkt,
+                b,
+                c,
+                GEOSGetGeometryN_r(wkt->handle, geom, i),
+                &part);
+            if (!err) {
+                b_ref(b, at + 4 + 4 * i, part);
+            }
+        }
+    }
+
+    return err || b->err;
+}
+
+static int w_feature(
+    struct wkt *wkt,
+    struct builder *b,
+    struct coords *c,
+    const GEOSGeometry *geom)
+{
+    static const uint16_t field[F_FIELDS] = { 4 };
+    int err;
+    size_t root;
+    size_t table;
+    size_t g;
+
+    root = b_begin(b);
+    table = b_table(b, field, F_FIELDS, 8, 4);
+    b_ref(b, root, table);
+
+    err = w_geometry(wkt, b, c, geom, &g);
+    if (!err) {
+        b_ref(b, table + 4, g);
+    }
+
+    b_end(b, root);
+
+    return err || b->err;
+}
+
+static void w_header(
+    struct builder *b,
+    const struct coords *c,
+    const struct wkt_node *extent,
+    uint8_t type,
+    uint64_t count,
+    uint16_t node_size)
+{
+    uint16_t field[H_FIELDS] = { 0, 4, 18, 19, 20, 0, 0, 0, 8, 16 };
+    uint8_t yes = 1;
+    size_t root;
+    size_t table;
+    size_t at;
+
+    if (count == 0) {
+        field[H_ENVELOPE] = 0;
+    }
+    if (!c->has_z) {
+        field[H_HAS_Z] = 0;
+    }
+    if (!c->has_m) {
+        field[H_HAS_M] = 0;
+    }
+
+    root = b_begin(b);
+    table = b_table(
+        b, field, H_FIELDS, (c->has_z || c->has_m) ? 24 : 20, 8);
+    b_ref(b, root, table);
+
+    b_put(b, table + 8, &count, sizeof(count));
+    b_put(b, table + 16, &node_size, sizeof(node_size));
+    b_put(b, table + 18, &type, sizeof(type));
+    if (c->has_z) {
+        b_put(b, table + 19, &yes, sizeof(yes));
+    }
+    if (c->has_m) {
+        b_put(b, table + 20, &yes, sizeof(yes));
+    }
+
+    if (count) {
+        double envelope[4];
+
+        envelope[0] = extent->minx;
+        envelope[1] = extent->miny;
+        envelope[2] = extent->maxx;
+        envelope[3] = extent->maxy;
+        at = b_vector(b, 4, envelope, sizeof(*envelope));
+        b_ref(b, table + 4, at);
+    }
+
+    b_end(b, root);
+}
+
+/* Box of geom, inverted (min above max) if it is empty. */
+static int w_box(struct wkt *wkt, const GEOSGeometry *geom, struct wkt_node *box)
+{
+    box->minx = box->miny = HUGE_VAL;
+    box->maxx = box->maxy = -HUGE_VAL;
+    box->offset = 0;
+
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0;
+    }
+
+    if (!GEOSGeom_getExtent_r(wkt->handle, geom,
+                              &box->minx, &box->miny,
+                              &box->maxx, &box->maxy)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Collections are split into features, like wkt_iterate(). */
+static int w_split(struct wkt *wkt, const GEOSGeometry *geom)
+{
+    int type = GEOSGeomTypeId_r(wkt->handle, geom);
+
+    return type == GEOS_MULTIPOINT ||
+        type == GEOS_MULTILINESTRING ||
+        type == GEOS_MULTIPOLYGON ||
+        type == GEOS_GEOMETRYCOLLECTION;
+}
+
+static const GEOSGeometry *w_member(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    int split,
+    size_t i)
+{
+    return split ? GEOSGetGeometryN_r(wkt->handle, geom, i) : geom;
+}
+
+int wkt_write_fgb(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
+{
+    int err = 1;
+    int split;
+    int n;
+    int type = -1;
+    size_t total;
+    size_t i;
+    size_t k;
+    size_t index;
+    size_t features;
+    struct builder b;
+    struct coords c;
+    struct wkt_node *node = NULL;
+    struct wkt_node *leaf;
+    struct wkt_node extent;
+    const GEOSGeometry *m;
+
+    memset(&b, 0, sizeof(b));
+    memset(&c, 0, sizeof(c));
+
+    do {
+        if (!w_little_endian()) {
+            break;
+        }
+
+        c.has_z = (GEOSHasZ_r(wkt->handle, geom) == 1);
+        c.has_m = (GEOSHasM_r(wkt->handle, geom) == 1);
+        split = w_split(wkt, geom);
+        n = split ? GEOSGetNumGeometries_r(wkt->handle, geom) : 1;
+        if (n < 0) {
+            break;
+        }
+
+        total = wkt_rtree_nodes(n, WKT_FGB_NODE_SIZE);
+        node = calloc(total ? total : 1, sizeof(*node));
+        if (node == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+        leaf = node + total - n;
+
+        /*
+         * Empty members have no box to index and nothing for a reader
+         * to draw, so they get no leaf and no feature.
+         */
+        extent.minx = extent.miny = HUGE_VAL;
+        extent.maxx = extent.maxy = -HUGE_VAL;
+        err = 0;
+        for (i=0, k=0; !err && i<(size_t)n; i++) {
+            int t;
+
+            m = w_member(wkt, geom, split, i);
+            if (m == NULL) {
+                err = 1;
+                break;
+            }
+            err = w_box(wkt, m, &leaf[k]);
+            if (err || leaf[k].minx > leaf[k].maxx) {
+                continue;
+            }
+            leaf[k].offset = i;
+            wkt_rtree_expand(&extent, &leaf[k]);
+
+            t = w_type(GEOSGeomTypeId_r(wkt->handle, m));
+            type = (type < 0 || type == t) ? t : FGB_UNKNOWN;
+            k++;
+        }
+
+        if (!err) {
+            /* fewer leaves, fewer inner nodes in front of them */
+            total = wkt_rtree_nodes(k, WKT_FGB_NODE_SIZE);
+            leaf = memmove(node + total - k, leaf, k * sizeof(*leaf));
+            err = wkt_rtree_sort(leaf, k);
+        }
+        if (err) {
+            break;
+        }
+
+        b_add(&b, WKT_FGB_MAGIC, MAGIC_LEN);
+        w_header(
+            &b,
+            &c,
+            &extent,
+            (type < 0) ? FGB_UNKNOWN : type,
+            k,
+            k ? WKT_FGB_NODE_SIZE : 0);
+
+        index = b_add(&b, NULL, total * sizeof(*node));
+        features = b.len;
+
+        /* features go in index order, leaves point at them */
+        for (i=0; !err && i<k; i++) {
+            m = w_member(wkt, geom, split, leaf[i].offset);
+            leaf[i].offset = b.len - features;
+            err = w_feature(wkt, &b, &c, m);
+        }
+        if (err || b.err) {
+            err = 1;
+            break;
+        }
+
+        wkt_rtree_build(node, k, WKT_FGB_NODE_SIZE);
+        b_put(&b, index, node, total * sizeof(*node));
+
+        err = wkt_stash(file, (const char *)b.data, b.len);
+
+    } while (0);
+
+    free(node);
+    free(c.xy);
+    free(c.ends);
+    free(c.z);
+    free(c.m);
+    free(b.data);
+
+    return err;
+}
+
+/*
+ * Reader
+ */
+
+static int r_get(const struct fbr *b, size_t at, void *v, size_t n)
+{
+    if (at > b->len || n > b->len - at) {
+        return 0;
+    }
+
+    memcpy(v, b->buf + at, n);
+
+    return 1;
+}
+
+/* Position of a table field, 0 if absent. */
+static size_t r_field(const struct fbr *b, size_t table, int id)
+{
+    int32_t soffset;
+    uint16_t vt_size;
+    uint16_t off;
+    size_t vt;
+
+    if (!r_get(b, table, &soffset, sizeof(soffset))) {
+        return 0;
+    }
+
+    vt = table - soffset;
+    if (!r_get(b, vt, &vt_size, sizeof(vt_size)) ||
+        (size_t)(4 + 2 * id + 2) > vt_size ||
+        !r_get(b, vt + 4 + 2 * id, &off, sizeof(off))) {
+        return 0;
+    }
+
+    return off ? table + off : 0;
+}
+
+/* Follow the offset field at 'at', 0 if absent or out of range. */
+static size_t r_ref(const struct fbr *b, size_t at)
+{
+    uint32_t v;
+
+    if (at == 0 || !r_get(b, at, &v, sizeof(v)) || v > b->len - at) {
+        return 0;
+    }
+
+    return at + v;
+}
+
+/* Read a scalar field, leaving *v alone if absent. */
+static void r_scalar(const struct fbr *b, size_t table, int id, void *v, size_t n)
+{
+    size_t at = r_field(b, table, id);
+
+    if (at) {
+        r_get(b, at, v, n);
+    }
+}
+
+/* Find a vector field; *n is 0 if absent. Returns 0 if corrupt. */
+static int r_vector(
+    const struct fbr *b,
+    size_t table,
+    int id,
+    size_t elem,
+    size_t *at,
+    uint32_t *n)
+{
+    size_t field = r_field(b, table, id);
+    size_t v;
+
+    *at = 0;
+    *n = 0;
+    if (field == 0) {
+        return 1;
+    }
+
+    v = r_ref(b, field);
+    if (v == 0 || !r_get(b, v, n, sizeof(*n))) {
+        return 0;
+    }
+    *at = v + sizeof(*n);
+
+    return *n <= (b->len - *at) / elem;
+}
+
+/*
+ * Coordinates [start, start+count) of the coordinate vectors. XY
+ * straight from an aligned buffer, anything else interleaved first.
+ */
+static GEOSCoordSequence *r_seq(
+    struct wkt *wkt,
+    const struct fbr *b,
+    const struct vectors *v,
+    size_t start,
+    size_t count)
+{
+    const unsigned char *p = b->buf + v->xy + start * 2 * sizeof(double);
+    int has_z = (v->z != 0);
+    int has_m = (v->m != 0);
+    size_t stride = 2 + has_z + has_m;
+    size_t i;
+    GEOSCoordSequence *seq;
+    double *copy;
+
+    if (stride == 2 && ((uintptr_t)p % sizeof(double)) == 0) {
+        return GEOSCoordSeq_copyFromBuffer_r(
+            wkt->handle, (const double *)p, count, 0, 0);
+    }
+
+    copy = malloc(count * stride * sizeof(*copy));
+    if (copy == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    for (i=0; i<count; i++) {
+        double *c = copy + i * stride;
+
+        memcpy(c, p + i * 2 * sizeof(*c), 2 * sizeof(*c));
+        if (has_z) {
+            memcpy(c + 2, b->buf + v->z + (start + i) * sizeof(*c),
+                   sizeof(*c));
+        }
+        if (has_m) {
+            memcpy(c + 2 + has_z, b->buf + v->m + (start + i) * sizeof(*c),
+                   sizeof(*c));
+        }
+    }
+    seq = GEOSCoordSeq_copyFromBuffer_r(
+        wkt->handle, copy, count, has_z, has_m);
+    free(copy);
+
+    return seq;
+}
+
+/* Coordinate range of part i; no ends means one part. */
+static int r_range(
+    const struct fbr *b,
+    size_t ends,
+    uint32_t nends,
+    uint32_t i,
+    size_t ncoords,
+    size_t *start,
+    size_t *end)
+{
+    uint32_t v = 0;
+
+    *start = 0;
+    *end = ncoords;
+    if (nends == 0) {
+        return 1;
+    }
+
+    if (i > 0) {
+        r_get(b, ends + 4 * (i - 1), &v, sizeof(v));
+        *start = v;
+    }
+    r_get(b, ends + 4 * i, &v, sizeof(v));
+    *end = v;
+
+    return *start <= *end && *end <= ncoords;
+}
+
+/* Destroy n geometries and the array holding them. */
+static void r_discard(struct wkt *wkt, GEOSGeometry **g, size_t n)
+{
+    while (n-- > 0) {
+        if (g[n]) {
+            GEOSGeom_destroy_r(wkt->handle, g[n]);
+        }
+    }
+    free(g);
+}
+
+/* Make the members into a collection, or destroy them on failure. */
+static GEOSGeometry *r_collection(
+    struct wkt *wkt,
+    int type,
+    GEOSGeometry **g,
+    size_t n,
+    size_t made)
+{
+    GEOSGeometry *geom = NULL;
+
+    if (n == 0) {
+        free(g);
+        return GEOSGeom_createEmptyCollection_r(wkt->handle, type);
+    }
+
+    if (made == n) {
+        /* the collection takes ownership of the members */
+        geom = GEOSGeom_createCollection_r(wkt->handle, type, g, n);
+        free(g);
+    } else {
+        r_discard(wkt, g, made);
+    }
+
+    return geom;
+}
+
+/* Points, or lines or rings split by ends. */
+static GEOSGeometry **r_parts(
+    struct wkt *wkt,
+    const struct fbr *b,
+    int type,
+    const struct vectors *v,
+    size_t ncoords,
+    size_t ends,
+    uint32_t nends,
+    size_t *n,
+    size_t *made)
+{
+    GEOSGeometry **g;
+    GEOSCoordSequence *seq;
+    size_t start;
+    size_t end;
+    size_t i;
+
+    *n = (type == GEOS_POINT) ? ncoords : (nends ? nends : 1);
+    *made = 0;
+
+    g = calloc(*n ? *n : 1, sizeof(*g));
+    if (g == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (i=0; i<*n; i++) {
+        if (type == GEOS_POINT) {
+            start = i;
+            end = i + 1;
+        } else if (!r_range(b, ends, nends, i, ncoords, &start, &end)) {
+            fprintf(stderr, "Corrupt FlatGeobuf part ends\n");
+            break;
+        }
+
+        seq = r_seq(wkt, b, v, start, end - start);
+        if (seq == NULL) {
+            break;
+        }
+
+        switch (type) {
+        case GEOS_POINT:
+            g[i] = GEOSGeom_createPoint_r(wkt->handle, seq);
+            break;
+        case GEOS_LINEARRING:
+            g[i] = GEOSGeom_createLinearRing_r(wkt->handle, seq);
+            break;
+        default:
+            g[i] = GEOSGeom_createLineString_r(wkt->handle, seq);
+            break;
+        }
+        if (g[i] == NULL) {
+            break;
+        }
+        (*made)++;
+    }
+
+    return g;
+}
+
+static GEOSGeometry *r_geometry(
+    struct wkt *wkt,
+    const struct fbr *b,
+    size_t table,
+    uint8_t type);
+
+/* Decode each Geometry in a parts vector. */
+static GEOSGeometry *r_nested(
+    struct wkt *wkt,
+    const struct fbr *b,
+    int type,
+    size_t parts,
+    uint32_t nparts)
+{
+    GEOSGeometry **g;
+    uint8_t inner = (type == GEOS_MULTIPOLYGON) ? FGB_POLYGON : FGB_UNKNOWN;
+    size_t made;
+
+    g = calloc(nparts ? nparts : 1, sizeof(*g));
+    if (g == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (made=0; made<nparts; made++) {
+        size_t part = r_ref(b, parts + 4 * made);
+
+        g[made] = part ? r_geometry(wkt, b, part, inner) : NULL;
+        if (g[made] == NULL) {
+            break;
+        }
+    }
+
+    return r_collection(wkt, type, g, nparts, made);
+}
+
+static GEOSGeometry *r_geometry(
+    struct wkt *wkt,
+    const struct fbr *b,
+    size_t table,
+    uint8_t type)
+{
+    GEOSGeometry *geom = NULL;
+    GEOSGeometry **g;
+    struct vectors v;
+    size_t ends;
+    size_t parts;
+    size_t ncoords;
+    size_t n;
+    size_t made;
+    uint32_t nxy;
+    uint32_t nz;
+    uint32_t nm;
+    uint32_t nends;
+    uint32_t nparts;
+    uint8_t t = FGB_UNKNOWN;
+
+    r_scalar(b, table, G_TYPE, &t, sizeof(t));
+    if (t == FGB_UNKNOWN) {
+        t = type;
+    }
+
+    if (!r_vector(b, table, G_XY, sizeof(double), &v.xy, &nxy) ||
+        !r_vector(b, table, G_Z, sizeof(double), &v.z, &nz) ||
+        !r_vector(b, table, G_M, sizeof(double), &v.m, &nm) ||
+        !r_vector(b, table, G_ENDS, sizeof(uint32_t), &ends, &nends) ||
+        !r_vector(b, table, G_PARTS, sizeof(uint32_t), &parts, &nparts) ||
+        (nxy % 2) != 0 ||
+        (nz && nz != nxy / 2) ||
+        (nm && nm != nxy / 2)) {
+        fprintf(stderr, "Corrupt FlatGeobuf geometry\n");
+        return NULL;
+    }
+    ncoords = nxy / 2;
+    if (nz == 0) {
+        v.z = 0;
+    }
+    if (nm == 0) {
+        v.m = 0;
+    }
+
+    switch (t) {
+    case FGB_POINT:
+        if (ncoords == 0) {
+            geom = GEOSGeom_createEmptyPoint_r(wkt->handle);
+        } else if ((g = r_parts(wkt, b, GEOS_POINT, &v, 1,
+                                0, 0, &n, &made)) != NULL) {
+            geom = (made == 1) ? g[0] : NULL;
+            free(g);
+        }
+        break;
+    case FGB_LINESTRING:
+        if (ncoords == 0) {
+            geom = GEOSGeom_createEmptyLineString_r(wkt->handle);
+        } else if ((g = r_parts(wkt, b, GEOS_LINESTRING, &v, ncoords,
+                                0, 0, &n, &made)) != NULL) {
+            geom = (made == 1) ? g[0] : NULL;
+            free(g);
+        }
+        break;
+    case FGB_POLYGON:
+        if (ncoords == 0) {
+            geom = GEOSGeom_createEmptyPolygon_r(wkt->handle);
+        } else if ((g = r_parts(wkt, b, GEOS_LINEARRING, &v, ncoords,
+                                ends, nends, &n, &made)) != NULL) {
+            if (made == n) {
+                /* shell first, then holes */
+                geom = GEOSGeom_createPolygon_r(
+                    wkt->handle, g[0], g + 1, n - 1);
+                free(g);
+            } else {
+                r_discard(wkt, g, made);
+            }
+        }
+        break;
+    case FGB_MULTIPOINT:
+        g = r_parts(wkt, b, GEOS_POINT, &v, ncoords, 0, 0, &n, &made);
+        if (g) {
+            geom = r_collection(wkt, GEOS_MULTIPOINT, g, n, made);
+        }
+        break;
+    case FGB_MULTILINESTRING:
+        if (ncoords == 0) {
+            geom = GEOSGeom_createEmptyCollection_r(
+                wkt->handle, GEOS_MULTILINESTRING);
+            break;
+        }
+        g = r_parts(wkt, b, GEOS_LINESTRING, &v, ncoords,
+                    ends, nends, &n, &made);
+        if (g) {
+            geom = r_collection(wkt, GEOS_MULTILINESTRING, g, n, made);
+        }
+        break;
+    case FGB_MULTIPOLYGON:
+        geom = r_nested(wkt, b, GEOS_MULTIPOLYGON, parts, nparts);
+        break;
+    case FGB_COLLECTION:
+        geom = r_nested(wkt, b, GEOS_GEOMETRYCOLLECTION, parts, nparts);
+        break;
+    default:
+        fprintf(stderr, "Unsupported FlatGeobuf geometry type %u\n", t);
+        break;
+    }
+
+    return geom;
+}
+
+/* Decode the feature at 'at'; *next is where the following one starts. */
+static int r_feature(struct gather *g, size_t at, size_t *next)
+{
+    const struct fgb *f = g->fgb;
+    uint32_t size;
+    uint32_t root;
+    size_t geometry;
+    struct fbr b;
+    GEOSGeometry *geom;
+
+    if (at > f->len || f->len - at < sizeof(size)) {
+        fprintf(stderr, "Truncated FlatGeobuf feature\n");
+        return 1;
+    }
+    memcpy(&size, f->data + at, sizeof(size));
+    if (size > f->len - at - sizeof(size)) {
+        fprintf(stderr, "Truncated FlatGeobuf feature\n");
+        return 1;
+    }
+
+    b.buf = f->data + at + sizeof(size);
+    b.len = size;
+    *next = at + sizeof(size) + size;
+
+    if (!r_get(&b, 0, &root, sizeof(root))) {
+        fprintf(stderr, "Corrupt FlatGeobuf feature\n");
+        return 1;
+    }
+
+    geometry = r_ref(&b, r_field(&b, root, F_GEOMETRY));
+    if (geometry == 0) {
+        return 0; /* no geometry, nothing to draw */
+    }
+
+    geom = r_geometry(g->wkt, &b, geometry, f->type);
+    if (geom == NULL) {
+        return 1;
+    }
+
+    if (g->n == g->size) {
+        size_t grow = g->size ? g->size * 2 : 1024;
+        GEOSGeometry **p = realloc(g->geom, grow * sizeof(*p));
+
+        if (p == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            GEOSGeom_destroy_r(g->wkt->handle, geom);
+            return 1;
+        }
+        g->geom = p;
+        g->size = grow;
+    }
+    g->geom[g->n++] = geom;
+
+    return 0;
+}
+
+static int r_hit(const struct wkt_node *leaf, size_t i, void *user_data)
+{
+    struct gather *g = user_data;
+    size_t next;
+
+    (void)i;
+    if (leaf->offset > g->fgb->len - g->fgb->features) {
+        fprintf(stderr, "Corrupt spatial index\n");
+        return 1;
+    }
+
+    return r_feature(g, g->fgb->features + leaf->offset, &next);
+}
+
+static int r_header(struct wkt *wkt, struct fgb *f)
+{
+    uint32_t size;
+    uint32_t root;
+    size_t nodes;
+    struct fbr b;
+
+    f->data = (const unsigned char *)wkt->input;
+    f->len = wkt->input_len;
+    f->node_size = WKT_FGB_NODE_SIZE;
+
+    if (f->len < MAGIC_LEN + sizeof(size) ||
+        memcmp(f->data, WKT_FGB_MAGIC, CHECK_LEN)) {
+        fprintf(stderr, "Not a FlatGeobuf file\n");
+        return 1;
+    }
+
+    memcpy(&size, f->data + MAGIC_LEN, sizeof(size));
+    if (size > f->len - MAGIC_LEN - sizeof(size)) {
+        fprintf(stderr, "Truncated FlatGeobuf header\n");
+        return 1;
+    }
+    b.buf = f->data + MAGIC_LEN + sizeof(size);
+    b.len = size;
+
+    if (!r_get(&b, 0, &root, sizeof(root))) {
+        fprintf(stderr, "Corrupt FlatGeobuf header\n");
+        return 1;
+    }
+
+    r_scalar(&b, root, H_GEOMETRY_TYPE, &f->type, sizeof(f->type));
+    r_scalar(&b, root, H_FEATURES_COUNT, &f->count, sizeof(f->count));
+    r_scalar(&b, root, H_INDEX_NODE_SIZE, &f->node_size, sizeof(f->node_size));
+
+    f->index = MAGIC_LEN + sizeof(size) + size;
+    f->features = f->index;
+
+    if (f->count == 0 || f->node_size == 0) {
+        f->node_size = 0; /* no index */
+        return 0;
+    }
+
+    nodes = wkt_rtree_nodes(f->count, f->node_size);
+    if (f->node_size < 2 ||
+        nodes > (f->len - f->index) / sizeof(struct wkt_node)) {
+        fprintf(stderr, "Corrupt FlatGeobuf index\n");
+        return 1;
+    }
+    f->features += nodes * sizeof(struct wkt_node);
+
+    return 0;
+}
+
+/*
+ * Read FlatGeobuf features into a collection. With a view and an
+ * index, only the index and the features it selects are touched.
+ */
+int wkt_read_fgb(struct wkt *wkt)
+{
+    int err = 1;
+    size_t at;
+    struct fgb f;
+    struct gather g;
+
+    memset(&f, 0, sizeof(f));
+    memset(&g, 0, sizeof(g));
+    g.wkt = wkt;
+    g.fgb = &f;
+
+    do {
+        if (!w_little_endian()) {
+            break;
+        }
+
+        err = r_header(wkt, &f);
+        if (err) {
+            break;
+        }
+
+        if (wkt->view.valid && f.node_size) {
+            if (wkt->map) {
+                /* no point reading ahead of a search */
+                madvise(wkt->map, wkt->map_len, MADV_RANDOM);
+                posix_fadvise(wkt->map_fd, 0, 0, POSIX_FADV_RANDOM);
+            }
+            err = wkt_rtree_search(
+                f.data + f.index,
+                f.count,
+                f.node_size,
+                &wkt->view.box,
+                r_hit,
+                &g);
+        } else {
+            for (at = f.features; !err && at < f.len; ) {
+                err = r_feature(&g, at, &at);
+            }
+        }
+
+        if (err) {
+            break;
+        }
+
+        wkt->geom = r_collection(
+            wkt, GEOS_GEOMETRYCOLLECTION, g.geom, g.n, g.n);
+        g.geom = NULL;
+        err = (wkt->geom == NULL);
+
+    } while (0);
+
+    if (g.geom) {
+        r_discard(wkt, g.geom, g.n);
+    }
+
+    return err;
+}
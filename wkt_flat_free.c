@@ -0,0 +1,29 @@
+/*
+   wkt_flat_free.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "wkt.h"
+
+/* Drop flat coordinate arrays, and the input they live in if mapped. */
+void wkt_flat_free(struct wkt *wkt)
+{
+    struct wkt_flat *flat = &wkt->flat;
+
+    if (flat->mapped) {
+        wkt_unmap(wkt);
+    } else {
+        free((void *)flat->x);
+        free((void *)flat->y);
+        free((void *)flat->z);
+        free((void *)flat->m);
+        free((void *)flat->node_type);
+        free((void *)flat->node_count);
+    }
+
+    memset(flat, 0, sizeof(*flat));
+}
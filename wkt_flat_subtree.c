@@ -0,0 +1,63 @@
+/*
+   wkt_flat_subtree.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include "wkt.h"
+
+/*
+ * Step past the preorder subtree at *node of flat's node columns,
+ * adding its coordinates to *coords. Fails on a tree that runs past
+ * the nodes or the coordinates, or on a type that is not a GEOS one.
+ */
+int wkt_flat_subtree(
+    const struct wkt_flat *flat,
+    size_t *node,
+    size_t *coords)
+{
+    int err = 0;
+    int type;
+    uint32_t count;
+    uint32_t i;
+
+    if (*node >= flat->nodes) {
+        fprintf(stderr, "Columnar nodes overrun\n");
+        return 1;
+    }
+
+    type = flat->node_type[*node];
+    count = flat->node_count[*node];
+    (*node)++;
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        *coords += count;
+        break;
+    case GEOS_POLYGON:
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        /* rings of a polygon, members of a collection */
+        for (i=0; !err && i<count; i++) {
+            err = wkt_flat_subtree(flat, node, coords);
+        }
+        break;
+    default:
+        fprintf(stderr, "Unsupported columnar type %d\n", type);
+        err = 1;
+        break;
+    }
+
+    if (!err && *coords > flat->n) {
+        fprintf(stderr, "Columnar coordinates overrun\n");
+        err = 1;
+    }
+
+    return err;
+}
@@ -0,0 +1,226 @@
+/*
+   wkt_geometry.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wkt.h"
+
+struct cursor {
+    size_t node;
+    size_t coord;
+};
+
+/*
+ * Build a collection of single points (the nodes == 0 shorthand). The
+ * GEOS C API cannot make the members of a collection share one
+ * coordinate sequence, so each point gets its own. Callers that only
+ * want the coordinates can use wkt_coords() instead.
+ */
+static GEOSGeometry *w_points(struct wkt *wkt)
+{
+    size_t i;
+    GEOSGeometry **point;
+    GEOSGeometry *geom = NULL;
+    struct wkt_flat *flat = &wkt->flat;
+
+    point = calloc(flat->n, sizeof(*point));
+    if (point == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (i=0; i<flat->n; i++) {
+        point[i] = GEOSGeom_createPointFromXY_r(
+            wkt->handle,
+            flat->x[i],
+            flat->y[i]);
+        if (point[i] == NULL) {
+            break;
+        }
+    }
+
+    if (i == flat->n) {
+        /* the collection takes ownership of the points */
+        geom = GEOSGeom_createCollection_r(
+            wkt->handle,
+            flat->type,
+            point,
+            flat->n);
+    } else {
+        while (i-- > 0) {
+            GEOSGeom_destroy_r(wkt->handle, point[i]);
+        }
+    }
+
+    free(point);
+
+    return geom;
+}
+
+static GEOSCoordSequence *w_seq(
+    struct wkt *wkt,
+    struct cursor *c,
+    unsigned int n)
+{
+    struct wkt_flat *flat = &wkt->flat;
+    GEOSCoordSequence *seq;
+
+    if (n > flat->n - c->coord) {
+        fprintf(stderr, "Columnar coordinates overrun\n");
+        return NULL;
+    }
+
+    seq = GEOSCoordSeq_copyFromArrays_r(
+        wkt->handle,
+        flat->x + c->coord,
+        flat->y + c->coord,
+        flat->z ? flat->z + c->coord : NULL,
+        flat->m ? flat->m + c->coord : NULL,
+        n);
+    c->coord += n;
+
+    return seq;
+}
+
+static GEOSGeometry *w_node(struct wkt *wkt, struct cursor *c);
+
+/* Build count child nodes. */
+static GEOSGeometry **w_children(
+    struct wkt *wkt,
+    struct cursor *c,
+    unsigned int count)
+{
+    GEOSGeometry **child;
+    unsigned int i;
+
+    child = calloc(count ? count : 1, sizeof(*child));
+    if (child == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    for (i=0; i<count; i++) {
+        child[i] = w_node(wkt, c);
+        if (child[i] == NULL) {
+            break;
+        }
+    }
+
+    if (i != count) {
+        while (i-- > 0) {
+            GEOSGeom_destroy_r(wkt->handle, child[i]);
+        }
+        free(child);
+        child = NULL;
+    }
+
+    return child;
+}
+
+static GEOSGeometry *w_node(struct wkt *wkt, struct cursor *c)
+{
+    struct wkt_flat *flat = &wkt->flat;
+    GEOSGeometry *geom = NULL;
+    GEOSGeometry **child;
+    GEOSCoordSequence *seq;
+    unsigned int count;
+    int type;
+
+    if (c->node >= flat->nodes) {
+        fprintf(stderr, "Columnar nodes overrun\n");
+        return NULL;
+    }
+
+    type = flat->node_type[c->node];
+    count = flat->node_count[c->node];
+    c->node++;
+
+    switch (type) {
+    case GEOS_POINT:
+        if (count == 0) {
+            geom = GEOSGeom_createEmptyPoint_r(wkt->handle);
+        } else if ((seq = w_seq(wkt, c, count)) != NULL) {
+            geom = GEOSGeom_createPoint_r(wkt->handle, seq);
+        }
+        break;
+    case GEOS_LINESTRING:
+        if (count == 0) {
+            geom = GEOSGeom_createEmptyLineString_r(wkt->handle);
+        } else if ((seq = w_seq(wkt, c, count)) != NULL) {
+            geom = GEOSGeom_createLineString_r(wkt->handle, seq);
+        }
+        break;
+    case GEOS_LINEARRING:
+        if ((seq = w_seq(wkt, c, count)) != NULL) {
+            geom = GEOSGeom_createLinearRing_r(wkt->handle, seq);
+        }
+        break;
+    case GEOS_POLYGON:
+        if (count == 0) {
+            geom = GEOSGeom_createEmptyPolygon_r(wkt->handle);
+        } else if ((child = w_children(wkt, c, count)) != NULL) {
+            /* shell first, then holes */
+            geom = GEOSGeom_createPolygon_r(
+                wkt->handle,
+                child[0],
+                child + 1,
+                count - 1);
+            free(child);
+        }
+        break;
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        if (count == 0) {
+            geom = GEOSGeom_createEmptyCollection_r(wkt->handle, type);
+        } else if ((child = w_children(wkt, c, count)) != NULL) {
+            geom = GEOSGeom_createCollection_r(
+                wkt->handle,
+                type,
+                child,
+                count);
+            free(child);
+        }
+        break;
+    default:
+        fprintf(stderr, "Unsupported columnar type %d\n", type);
+        break;
+    }
+
+    return geom;
+}
+
+/*
+ * Return the input geometry, building it from flat coordinate arrays
+ * the first time it is needed. Building counts as reading.
+ */
+GEOSGeometry *wkt_geometry(struct wkt *wkt)
+{
+    struct wkt_flat *flat = &wkt->flat;
+    struct cursor c = { 0, 0 };
+    uint64_t start;
+
+    if (wkt->geom != NULL || (flat->n == 0 && flat->nodes == 0)) {
+        return wkt->geom;
+    }
+
+    start = wkt_stats_begin(WKT_PHASE_READ);
+    if (flat->nodes == 0) {
+        wkt->geom = w_points(wkt);
+    } else {
+        wkt->geom = w_node(wkt, &c);
+    }
+    wkt_stats_phase(WKT_PHASE_READ, start);
+
+    if (wkt->geom != NULL) {
+        /* The geometry is authoritative from here on. */
+        wkt_flat_free(wkt);
+    }
+
+    return wkt->geom;
+}
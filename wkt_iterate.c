@@ -7,31 +7,58 @@
 
 #include "wkt.h"
 
+/*
+ * Call iterator with geom and its type name, as wkt_iterate() does
+ * for each member.
+ */
+int wkt_iterate_one(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_iterator_t iterator,
+    void *user_data)
+{
+    int err;
+    const char *name;
+    char *gtype;
+
+    name = wkt_type_name(GEOSGeomTypeId_r(wkt->handle, geom));
+    if (name) {
+        return iterator(wkt, geom, name, user_data);
+    }
+
+    /* newer types: ask GEOS */
+    gtype = GEOSGeomType_r(wkt->handle, geom);
+    if (gtype == NULL) {
+        return 1;
+    }
+    err = iterator(wkt, geom, gtype, user_data);
+    GEOSFree_r(wkt->handle, gtype);
+
+    return err;
+}
+
 int wkt_iterate(struct wkt *wkt, wkt_iterator_t iterator, void *user_data)
 {
     int err = 1;
     int i;
     int n;
-    char *gtype;
+    const GEOSGeometry *top;
     const GEOSGeometry *geom;
 
+    top = wkt_geometry(wkt);
+    if (top == NULL) {
+        return err;
+    }
+
     /* iterate across geometries */
-    n = GEOSGetNumGeometries_r(wkt->handle, wkt->geom);
+    n = GEOSGetNumGeometries_r(wkt->handle, top);
     for (i=0; i<n; i++) {
-        geom = GEOSGetGeometryN_r(wkt->handle, wkt->geom, i);
+        geom = GEOSGetGeometryN_r(wkt->handle, top, i);
         if (geom == NULL) {
             break;
         }
 
-        gtype = GEOSGeomType_r(wkt->handle, geom);
-        if (gtype == NULL) {
-            break;
-        }
-
-        err = iterator(wkt, geom, gtype, user_data);
-
-        GEOSFree_r(wkt->handle, gtype);
-
+        err = wkt_iterate_one(wkt, geom, iterator, user_data);
         if (err) {
             break;
         }
@@ -39,4 +66,3 @@ int wkt_iterate(struct wkt *wkt, wkt_iterator_t iterator, void *user_data)
 
     return err;
 }
-
@@ -8,6 +8,11 @@
 #include <stdio.h>
 #include "wkt.h"
 
+/*
+ * Call handler with each x, y of the coordinate sequence of geom. Z
+ * and M, if any, are left out by GEOS as the sequence is copied, so
+ * every layout comes out as XY; wkt_iterate_span() has all of them.
+ */
 int wkt_iterate_coord_seq(
     struct wkt *wkt,
     const GEOSGeometry *geom,
@@ -15,11 +20,10 @@ int wkt_iterate_coord_seq(
     void *user_data)
 {
     int err = 1;
-    int rc;
     unsigned int n;
-    unsigned int d;
     unsigned int i;
-    const GEOSCoordSequence* s;
+    const GEOSCoordSequence *s;
+    double *xy;
 
     do {
         s = GEOSGeom_getCoordSeq_r(wkt->handle, geom);
@@ -27,33 +31,22 @@ int wkt_iterate_coord_seq(
             break;
         }
 
-        rc = GEOSCoordSeq_getSize_r(wkt->handle, s, &n);
-        if (!rc) {
+        if (!GEOSCoordSeq_getSize_r(wkt->handle, s, &n)) {
             break;
         }
 
-        rc = GEOSCoordSeq_getDimensions_r(wkt->handle, s, &d);
-        if (!rc) {
+        xy = wkt_scratch(wkt, 2 * (size_t)n);
+        if (n && xy == NULL) {
             break;
         }
-
-        if (d != 2) {
-            fprintf(stderr, "Unsupported Point dimension %u\n", d);
+        if (n && !GEOSCoordSeq_copyToBuffer_r(wkt->handle, s, xy, 0, 0)) {
             break;
         }
 
         err = 0;
 
         for (i=0; i<n; i++) {
-            double x;
-            double y;
-
-            rc = GEOSCoordSeq_getXY_r(wkt->handle, s, i, &x, &y);
-            if (!rc) {
-                err = 1;
-                break;
-            }
-            err = handler(wkt, i, n, x, y, user_data);
+            err = handler(wkt, i, n, xy[2 * i], xy[2 * i + 1], user_data);
             if (err) {
                 break;
             }
@@ -63,4 +56,3 @@ int wkt_iterate_coord_seq(
 
     return err;
 }
-
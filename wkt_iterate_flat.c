@@ -0,0 +1,71 @@
+/*
+   wkt_iterate_flat.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include "wkt.h"
+
+/*
+ * Walk the coordinate sequences of flat input without building any
+ * geometry. Only sequences of the given GEOS type (GEOS_POINT,
+ * GEOS_LINESTRING or GEOS_LINEARRING) are handed to the handler, or
+ * all of them if type is negative. The handler is called as it would
+ * be by wkt_iterate_coord_seq().
+ */
+int wkt_iterate_flat(
+    struct wkt *wkt,
+    int type,
+    int (*handler)(struct wkt *, unsigned, unsigned, double, double, void *),
+    void *user_data)
+{
+    int err = 0;
+    const struct wkt_flat *flat = &wkt->flat;
+    size_t node;
+    size_t coord = 0;
+    unsigned int n;
+    unsigned int i;
+    int t;
+
+    if (flat->nodes == 0) {
+        /* a collection of single points */
+        if (type >= 0 && type != GEOS_POINT) {
+            return 0;
+        }
+        for (coord=0; !err && coord<flat->n; coord++) {
+            err = handler(wkt, 0, 1, flat->x[coord], flat->y[coord], user_data);
+        }
+        return err;
+    }
+
+    for (node=0; !err && node<flat->nodes; node++) {
+        t = flat->node_type[node];
+        if (t != GEOS_POINT && t != GEOS_LINESTRING && t != GEOS_LINEARRING) {
+            continue;
+        }
+
+        n = flat->node_count[node];
+        if (n > flat->n - coord) {
+            fprintf(stderr, "Columnar coordinates overrun\n");
+            err = 1;
+            break;
+        }
+
+        if (type < 0 || type == t) {
+            for (i=0; !err && i<n; i++) {
+                err = handler(
+                    wkt,
+                    i,
+                    n,
+                    flat->x[coord + i],
+                    flat->y[coord + i],
+                    user_data);
+            }
+        }
+        coord += n;
+    }
+
+    return err;
+}
@@ -0,0 +1,315 @@
+/*
+   wkt_iterate_parallel.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "wkt.h"
+
+/*
+ * wkt_iterate() on several threads. Every thread starts with an equal
+ * share of the top level members and takes them from the front of its
+ * share a few at a time. A thread that runs out steals the back half
+ * of another thread's share, so uneven work evens out without a
+ * shared queue. A share is a [lo, hi) range packed into one 64 bit
+ * word, so taking and stealing are each one compare and swap.
+ */
+
+#define TASKS_PER_THREAD 64
+#define GRAIN_MAX 256 /* members taken at a time */
+#define LINE 64 /* keep shares on separate cache lines */
+
+struct share {
+    uint64_t range; /* lo in the low half, hi in the high half */
+    char pad[LINE - sizeof(uint64_t)];
+};
+
+struct job {
+    struct wkt *wkt;
+    const GEOSGeometry *top;
+    wkt_iterator_t iterator;
+    char *slots;
+    size_t slot_size;
+    unsigned int threads;
+    uint32_t grain;
+    struct share *share;
+    int failed;
+};
+
+struct worker {
+    struct job *job;
+    unsigned int id;
+    pthread_t tid;
+};
+
+static uint64_t w_range(uint32_t lo, uint32_t hi)
+{
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t w_lo(uint64_t range)
+{
+    return (uint32_t)range;
+}
+
+static uint32_t w_hi(uint64_t range)
+{
+    return (uint32_t)(range >> 32);
+}
+
+/* Take up to grain members from the front of our own share. */
+static int w_take(
+    struct share *share,
+    uint32_t grain,
+    uint32_t *lo,
+    uint32_t *hi)
+{
+    uint64_t range = __atomic_load_n(&share->range, __ATOMIC_RELAXED);
+    uint32_t end;
+
+    for (;;) {
+        if (w_lo(range) >= w_hi(range)) {
+            return 0;
+        }
+        end = w_hi(range) - w_lo(range) > grain ?
+            w_lo(range) + grain : w_hi(range);
+        if (__atomic_compare_exchange_n(&share->range, &range,
+                                        w_range(end, w_hi(range)), 1,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            *lo = w_lo(range);
+            *hi = end;
+            return 1;
+        }
+    }
+}
+
+/* Take the back half of another share; the front stays with its owner. */
+static int w_steal(struct share *share, uint32_t *lo, uint32_t *hi)
+{
+    uint64_t range = __atomic_load_n(&share->range, __ATOMIC_RELAXED);
+    uint32_t mid;
+
+    for (;;) {
+        if (w_lo(range) >= w_hi(range)) {
+            return 0;
+        }
+        mid = w_lo(range) + (w_hi(range) - w_lo(range)) / 2;
+        if (__atomic_compare_exchange_n(&share->range, &range,
+                                        w_range(w_lo(range), mid), 1,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            *lo = mid;
+            *hi = w_hi(range);
+            return 1;
+        }
+    }
+}
+
+/* Visit members lo .. hi-1 with our own context and slot. */
+static int w_visit(
+    struct job *job,
+    struct wkt *wkt,
+    void *slot,
+    uint32_t lo,
+    uint32_t hi)
+{
+    int err = 0;
+    uint32_t i;
+    const GEOSGeometry *geom;
+
+    for (i=lo; !err && i<hi; i++) {
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+            break;
+        }
+        geom = GEOSGetGeometryN_r(wkt->handle, job->top, i);
+        if (geom == NULL) {
+            err = 1;
+            break;
+        }
+        err = wkt_iterate_one(wkt, geom, job->iterator, slot);
+    }
+
+    return err;
+}
+
+static void *w_worker(void *arg)
+{
+    struct worker *worker = arg;
+    struct job *job = worker->job;
+    struct share *own = &job->share[worker->id];
+    void *slot = job->slots + worker->id * job->slot_size;
+    struct wkt wkt;
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    unsigned int k;
+    int err;
+    uint64_t start = wkt_stats_now();
+
+    /* a context and writers of our own, set up the same way */
+    memset(&wkt, 0, sizeof(wkt));
+    wkt.reader = WKT_IO_NONE;
+    wkt.writer = job->wkt->writer;
+    wkt.precision = job->wkt->precision;
+    err = wkt_open(&wkt);
+
+    while (!err && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        if (w_take(own, job->grain, &lo, &hi)) {
+            err = w_visit(job, &wkt, slot, lo, hi);
+            continue;
+        }
+
+        /* out of work: steal, going round from our neighbour */
+        for (k=1; k<job->threads; k++) {
+            struct share *victim =
+                &job->share[(worker->id + k) % job->threads];
+            if (w_steal(victim, &lo, &hi)) {
+                break;
+            }
+        }
+        if (k == job->threads) {
+            /* every share was empty; what is left is being visited */
+            break;
+        }
+        __atomic_store_n(&own->range, w_range(lo, hi), __ATOMIC_RELEASE);
+    }
+
+    if (err) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    if (wkt.handle) {
+        wkt_close(&wkt);
+    }
+
+    wkt_stats_trace("iterate", start);
+
+    return NULL;
+}
+
+/*
+ * Call iterator for every top level member of the input, like
+ * wkt_iterate(), on wkt->threads threads and in no particular order.
+ * Each thread has its own GEOS context, handed to iterator as wkt,
+ * and its own user data: slots holds one slot of slot_size bytes per
+ * thread (at least one), which the caller sets up. Once all members
+ * have been visited, reduce, if given, is called on the calling thread
+ * with each slot in turn to merge it into user_data. It is not called
+ * if an iterator failed.
+ */
+int wkt_iterate_parallel(
+    struct wkt *wkt,
+    wkt_iterator_t iterator,
+    void *slots,
+    size_t slot_size,
+    wkt_reduce_t reduce,
+    void *user_data)
+{
+    int err = 1;
+    unsigned int threads = wkt->threads ? wkt->threads : 1;
+    unsigned int started = 0;
+    unsigned int i;
+    struct worker *worker = NULL;
+    struct job job;
+    uint32_t n;
+    uint32_t lo;
+    uint32_t hi;
+    int count;
+
+    memset(&job, 0, sizeof(job));
+    job.top = wkt_geometry(wkt);
+    if (job.top == NULL) {
+        return err;
+    }
+    count = GEOSGetNumGeometries_r(wkt->handle, job.top);
+    if (count < 0) {
+        return err;
+    }
+    n = count;
+
+    if (threads > n) {
+        threads = n ? n : 1;
+    }
+
+    do {
+        if (threads == 1) {
+            /* nothing to share */
+            err = wkt_iterate(wkt, iterator, slots);
+            if (!err && reduce) {
+                err = reduce(wkt, user_data, slots);
+            }
+            break;
+        }
+
+        job.wkt = wkt;
+        job.iterator = iterator;
+        job.slots = slots;
+        job.slot_size = slot_size;
+        job.threads = threads;
+        job.grain = n / (threads * TASKS_PER_THREAD);
+        if (job.grain == 0) {
+            job.grain = 1;
+        } else if (job.grain > GRAIN_MAX) {
+            job.grain = GRAIN_MAX;
+        }
+
+        if (posix_memalign((void **)&job.share, LINE,
+                           threads * sizeof(*job.share))) {
+            job.share = NULL;
+        }
+        worker = calloc(threads, sizeof(*worker));
+        if (job.share == NULL || worker == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+
+        for (i=0; i<threads; i++) {
+            lo = (uint64_t)n * i / threads;
+            hi = (uint64_t)n * (i + 1) / threads;
+            job.share[i].range = w_range(lo, hi);
+            worker[i].job = &job;
+            worker[i].id = i;
+        }
+
+        for (i=0; i<threads; i++) {
+            if (pthread_create(&worker[i].tid, NULL, w_worker, &worker[i])) {
+                fprintf(stderr, "Could not create thread\n");
+                __atomic_store_n(&job.failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            started++;
+        }
+
+        for (i=0; i<started; i++) {
+            pthread_join(worker[i].tid, NULL);
+        }
+
+        if (started < threads) {
+            break;
+        }
+
+        /* a worker that could not open its context leaves work undone */
+        err = job.failed;
+        for (i=0; !err && i<threads; i++) {
+            if (w_lo(job.share[i].range) < w_hi(job.share[i].range)) {
+                err = 1;
+            }
+        }
+
+        for (i=0; !err && reduce && i<threads; i++) {
+            err = reduce(wkt, user_data, job.slots + i * slot_size);
+        }
+
+    } while (0);
+
+    free(job.share);
+    free(worker);
+
+    return err;
+}
@@ -0,0 +1,129 @@
+/*
+   wkt_iterate_span.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include "wkt.h"
+
+/*
+ * Hand the whole coordinate sequence of geom (a point, line string or
+ * linear ring) to handler as one span. The coordinates are copied in
+ * one go into wkt->scratch, which is reused from call to call, so the
+ * span is only good until the handler returns.
+ */
+int wkt_iterate_span(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_span_t handler,
+    void *user_data)
+{
+    int err = 1;
+    int has_z;
+    int has_m;
+    unsigned int n;
+    double *xy;
+    const GEOSCoordSequence *s;
+    struct wkt_span span;
+
+    do {
+        s = GEOSGeom_getCoordSeq_r(wkt->handle, geom);
+        if (s == NULL) {
+            break;
+        }
+
+        if (!GEOSCoordSeq_getSize_r(wkt->handle, s, &n)) {
+            break;
+        }
+
+        has_z = (GEOSHasZ_r(wkt->handle, geom) == 1);
+        has_m = (GEOSHasM_r(wkt->handle, geom) == 1);
+
+        span.n = n;
+        span.stride = 2 + has_z + has_m;
+        span.type = GEOSGeomTypeId_r(wkt->handle, geom);
+
+        xy = wkt_scratch(wkt, (size_t)n * span.stride);
+        if (n && xy == NULL) {
+            break;
+        }
+        if (n && !GEOSCoordSeq_copyToBuffer_r(
+                wkt->handle, s, xy, has_z, has_m)) {
+            break;
+        }
+
+        span.x = xy;
+        span.y = xy + 1;
+        span.z = has_z ? xy + 2 : NULL;
+        span.m = has_m ? xy + 2 + has_z : NULL;
+
+        err = handler(wkt, &span, user_data);
+
+    } while (0);
+
+    return err;
+}
+
+/*
+ * wkt_iterate_flat() a sequence at a time. The spans point straight
+ * into the flat arrays, nothing is copied. Input that is only single
+ * points comes as one span of all of them.
+ */
+int wkt_iterate_flat_span(
+    struct wkt *wkt,
+    int type,
+    wkt_span_t handler,
+    void *user_data)
+{
+    int err = 0;
+    const struct wkt_flat *flat = &wkt->flat;
+    size_t node;
+    size_t coord = 0;
+    unsigned int n;
+    int t;
+    struct wkt_span span;
+
+    span.stride = 1;
+
+    if (flat->nodes == 0) {
+        if ((type >= 0 && type != GEOS_POINT) || flat->n == 0) {
+            return 0;
+        }
+        span.n = flat->n;
+        span.type = GEOS_POINT;
+        span.x = flat->x;
+        span.y = flat->y;
+        span.z = flat->z;
+        span.m = flat->m;
+        return handler(wkt, &span, user_data);
+    }
+
+    for (node=0; !err && node<flat->nodes; node++) {
+        t = flat->node_type[node];
+        if (t != GEOS_POINT && t != GEOS_LINESTRING && t != GEOS_LINEARRING) {
+            continue;
+        }
+
+        n = flat->node_count[node];
+        if (n > flat->n - coord) {
+            fprintf(stderr, "Columnar coordinates overrun\n");
+            err = 1;
+            break;
+        }
+
+        if (type < 0 || type == t) {
+            span.n = n;
+            span.type = t;
+            span.x = flat->x + coord;
+            span.y = flat->y + coord;
+            span.z = flat->z ? flat->z + coord : NULL;
+            span.m = flat->m ? flat->m + coord : NULL;
+            err = handler(wkt, &span, user_data);
+        }
+        coord += n;
+    }
+
+    return err;
+}
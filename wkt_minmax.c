@@ -0,0 +1,70 @@
+/*
+   wkt_minmax.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "wkt.h"
+
+/*
+ * Grow box to take in n coordinates from separate x and y arrays, in
+ * one pass. NaN coordinates are skipped. A fresh box starts with the
+ * minimums at HUGE_VAL and the maximums at -HUGE_VAL, and is still
+ * like that (minx > maxx) if nothing was taken in.
+ */
+void wkt_minmax(
+    const double *x,
+    const double *y,
+    size_t n,
+    struct wkt_node *box)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /* two at a time; min and max return the second operand on NaN */
+    if (n >= 2) {
+        __m128d minx = _mm_set1_pd(box->minx);
+        __m128d maxx = _mm_set1_pd(box->maxx);
+        __m128d miny = _mm_set1_pd(box->miny);
+        __m128d maxy = _mm_set1_pd(box->maxy);
+        double v[2];
+
+        for (; i + 2 <= n; i += 2) {
+            __m128d vx = _mm_loadu_pd(x + i);
+            __m128d vy = _mm_loadu_pd(y + i);
+            minx = _mm_min_pd(vx, minx);
+            maxx = _mm_max_pd(vx, maxx);
+            miny = _mm_min_pd(vy, miny);
+            maxy = _mm_max_pd(vy, maxy);
+        }
+
+        _mm_storeu_pd(v, minx);
+        box->minx = v[0] < v[1] ? v[0] : v[1];
+        _mm_storeu_pd(v, maxx);
+        box->maxx = v[0] > v[1] ? v[0] : v[1];
+        _mm_storeu_pd(v, miny);
+        box->miny = v[0] < v[1] ? v[0] : v[1];
+        _mm_storeu_pd(v, maxy);
+        box->maxy = v[0] > v[1] ? v[0] : v[1];
+    }
+#endif
+
+    for (; i<n; i++) {
+        if (x[i] < box->minx) {
+            box->minx = x[i];
+        }
+        if (x[i] > box->maxx) {
+            box->maxx = x[i];
+        }
+        if (y[i] < box->miny) {
+            box->miny = y[i];
+        }
+        if (y[i] > box->maxy) {
+            box->maxy = y[i];
+        }
+    }
+}
@@ -14,6 +14,13 @@ static void wkt_message(const char *message, void *userdata)
     fprintf(stderr, "GEOS-%s: %s\n", locus, message);
 }
 
+/* Send the notices and errors of a GEOS context to stderr. */
+void wkt_messages(GEOSContextHandle_t handle)
+{
+    GEOSContext_setNoticeMessageHandler_r(handle, wkt_message, "NOTICE");
+    GEOSContext_setErrorMessageHandler_r(handle, wkt_message, "ERROR");
+}
+
 int wkt_open(struct wkt *wkt)
 {
     int err = 1;
@@ -34,6 +41,8 @@ int wkt_open(struct wkt *wkt)
         wkt->wkbr = GEOSWKBReader_create_r(wkt->handle);
         err = (wkt->wkbr == NULL);
         break;
+    case WKT_IO_COLUMNAR:
+    case WKT_IO_FGB:
     case WKT_IO_NONE:
         err = 0;
         break;
@@ -50,12 +59,20 @@ int wkt_open(struct wkt *wkt)
     case WKT_IO_ASCII:
         wkt->wktw = GEOSWKTWriter_create_r(wkt->handle);
         err = (wkt->wktw == NULL);
+        if (!err && wkt->precision.valid) {
+            /* for what wkt_write_text() leaves to GEOS */
+            GEOSWKTWriter_setRoundingPrecision_r(
+                wkt->handle, wkt->wktw, wkt->precision.places);
+            GEOSWKTWriter_setTrim_r(wkt->handle, wkt->wktw, 1);
+        }
         break;
     case WKT_IO_BINARY:
     case WKT_IO_HEX:
         wkt->wkbw = GEOSWKBWriter_create_r(wkt->handle);
         err = (wkt->wkbw == NULL);
         break;
+    case WKT_IO_COLUMNAR:
+    case WKT_IO_FGB:
     case WKT_IO_NONE:
         err = 0;
         break;
@@ -64,8 +81,7 @@ int wkt_open(struct wkt *wkt)
         break;
     }
 
-    GEOSContext_setNoticeMessageHandler_r(wkt->handle, wkt_message, "NOTICE");
-    GEOSContext_setErrorMessageHandler_r(wkt->handle, wkt_message, "ERROR");
+    wkt_messages(wkt->handle);
 
     return err;
 }
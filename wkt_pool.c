@@ -0,0 +1,159 @@
+/*
+   wkt_pool.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wkt.h"
+
+/*
+ * Open sessions for long running callers. A session is a struct wkt
+ * whose GEOS context, readers and writers stay open from one document
+ * to the next. Each thread gets its own from wkt_pool_get(), found
+ * through thread specific data, so there is no lock to take. When a
+ * thread exits its session is reset and left for the next new thread
+ * to adopt; sessions are only closed by wkt_pool_destroy().
+ */
+
+struct wkt_pool_entry {
+    struct wkt wkt;
+    struct wkt_pool_entry *next;
+    int busy; /* held by a live thread */
+};
+
+/* Thread exit: drop the document and hand the session back. */
+static void w_release(void *arg)
+{
+    struct wkt_pool_entry *entry = arg;
+
+    wkt_reset(&entry->wkt);
+    __atomic_store_n(&entry->busy, 0, __ATOMIC_RELEASE);
+}
+
+/* Settings go back to the pool's, whatever the last user changed. */
+static void w_settings(struct wkt *wkt, const struct wkt *proto)
+{
+    wkt->reader = proto->reader;
+    wkt->writer = proto->writer;
+    wkt->threads = proto->threads;
+    wkt->budget = proto->budget;
+    wkt->map_flags = proto->map_flags;
+    wkt->view = proto->view;
+    wkt->precision = proto->precision;
+}
+
+static struct wkt_pool_entry *w_adopt(struct wkt_pool *pool)
+{
+    struct wkt_pool_entry *entry;
+    int idle;
+
+    entry = __atomic_load_n(&pool->entries, __ATOMIC_ACQUIRE);
+    for (; entry; entry = entry->next) {
+        idle = 0;
+        if (__atomic_compare_exchange_n(&entry->busy, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static struct wkt_pool_entry *w_create(struct wkt_pool *pool)
+{
+    struct wkt_pool_entry *entry = calloc(1, sizeof(*entry));
+
+    if (entry == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    w_settings(&entry->wkt, &pool->proto);
+    if (wkt_open(&entry->wkt)) {
+        if (entry->wkt.handle) {
+            wkt_close(&entry->wkt);
+        }
+        free(entry);
+        return NULL;
+    }
+    entry->busy = 1;
+
+    entry->next = __atomic_load_n(&pool->entries, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pool->entries, &entry->next, entry,
+                                        1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+        ;
+    }
+
+    return entry;
+}
+
+/*
+ * Sessions are opened with the reader, writer and other settings of
+ * proto, which is copied and not opened itself.
+ */
+int wkt_pool_init(struct wkt_pool *pool, const struct wkt *proto)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->proto = *proto;
+
+    if (pthread_key_create(&pool->key, w_release)) {
+        fprintf(stderr, "Could not create thread key\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The calling thread's session, ready for wkt_read() and wkt_write().
+ * Whatever the thread read last is dropped first, and the settings are
+ * the pool's again. Returns NULL if a session could not be opened.
+ */
+struct wkt *wkt_pool_get(struct wkt_pool *pool)
+{
+    struct wkt_pool_entry *entry = pthread_getspecific(pool->key);
+
+    if (entry) {
+        wkt_reset(&entry->wkt);
+    } else {
+        entry = w_adopt(pool);
+        if (entry == NULL) {
+            entry = w_create(pool);
+        }
+        if (entry == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(pool->key, entry)) {
+            fprintf(stderr, "Could not set thread key\n");
+            __atomic_store_n(&entry->busy, 0, __ATOMIC_RELEASE);
+            return NULL;
+        }
+    }
+
+    w_settings(&entry->wkt, &pool->proto);
+
+    return &entry->wkt;
+}
+
+/* Close every session; no thread may be using one. */
+void wkt_pool_destroy(struct wkt_pool *pool)
+{
+    struct wkt_pool_entry *entry = pool->entries;
+    struct wkt_pool_entry *next;
+
+    pthread_key_delete(pool->key);
+
+    for (; entry; entry = next) {
+        next = entry->next;
+        wkt_close(&entry->wkt);
+        free(entry);
+    }
+
+    pool->entries = NULL;
+}
@@ -0,0 +1,153 @@
+/*
+   wkt_query.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wkt.h"
+
+/*
+ * In-memory spatial index over the top level features: a packed
+ * Hilbert R-tree, see wkt_rtree.c, over their cached envelopes. Leaf
+ * offsets are feature indexes. Empty features meet nothing and are
+ * left out.
+ */
+
+#define NODE_SIZE 16
+
+struct hits {
+    size_t *i;
+    size_t n;
+    size_t size;
+};
+
+/*
+ * Build the index if there is none for the current document. It is
+ * kept with the envelopes and dropped along with them. The geometry
+ * is built first, so the envelopes are those of the GEOS features.
+ */
+int wkt_index(struct wkt *wkt)
+{
+    const struct wkt_node *env;
+    struct wkt_node *node;
+    struct wkt_node *leaf;
+    size_t features;
+    size_t n = 0;
+    size_t total;
+    size_t i;
+
+    if (wkt_geometry(wkt) == NULL) {
+        return 1;
+    }
+
+    env = wkt_envelopes(wkt, &features);
+    if (env == NULL) {
+        return 1;
+    }
+    if (wkt->envelope.tree) {
+        return 0;
+    }
+
+    for (i=0; i<features; i++) {
+        n += (env[i].minx <= env[i].maxx);
+    }
+
+    total = wkt_rtree_nodes(n, NODE_SIZE);
+    node = malloc((total ? total : 1) * sizeof(*node));
+    if (node == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    /* leaves go last */
+    leaf = node + total - n;
+    for (i=0; i<features; i++) {
+        if (env[i].minx <= env[i].maxx) {
+            *leaf++ = env[i];
+        }
+    }
+
+    if (wkt_rtree_sort(node + total - n, n)) {
+        free(node);
+        return 1;
+    }
+    wkt_rtree_build(node, n, NODE_SIZE);
+
+    wkt->envelope.tree = node;
+    wkt->envelope.leaves = n;
+
+    return 0;
+}
+
+static int w_hit(const struct wkt_node *leaf, size_t i, void *user_data)
+{
+    struct hits *hits = user_data;
+    size_t *grow;
+
+    (void)i;
+    if (hits->n == hits->size) {
+        hits->size = hits->size ? 2 * hits->size : 256;
+        grow = realloc(hits->i, hits->size * sizeof(*grow));
+        if (grow == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        hits->i = grow;
+    }
+    hits->i[hits->n++] = leaf->offset;
+
+    return 0;
+}
+
+static int w_compare(const void *a, const void *b)
+{
+    size_t ia = *(const size_t *)a;
+    size_t ib = *(const size_t *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+/*
+ * Call iterator, as wkt_iterate() would, for just the top level
+ * features whose envelopes meet box, in input order. The index is
+ * built on first use.
+ */
+int wkt_query(
+    struct wkt *wkt,
+    const struct wkt_node *box,
+    wkt_iterator_t iterator,
+    void *user_data)
+{
+    int err;
+    struct hits hits = { NULL, 0, 0 };
+    const GEOSGeometry *top;
+    const GEOSGeometry *geom;
+    size_t i;
+
+    err = wkt_index(wkt);
+    if (!err) {
+        err = wkt_rtree_search(wkt->envelope.tree, wkt->envelope.leaves,
+                               NODE_SIZE, box, w_hit, &hits);
+    }
+    if (!err) {
+        /* leaves are in Hilbert order */
+        qsort(hits.i, hits.n, sizeof(*hits.i), w_compare);
+    }
+
+    top = wkt->geom;
+    for (i=0; !err && i<hits.n; i++) {
+        geom = GEOSGetGeometryN_r(wkt->handle, top, hits.i[i]);
+        if (geom == NULL) {
+            err = 1;
+            break;
+        }
+        err = wkt_iterate_one(wkt, geom, iterator, user_data);
+    }
+
+    free(hits.i);
+
+    return err;
+}
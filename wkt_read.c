@@ -5,11 +5,66 @@
 
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "wkt.h"
 
+/*
+ * The GEOS WKT reader wants a NUL terminated string. A mapping is
+ * zero filled to the end of its last page, unless the file ends
+ * exactly on a page boundary; copy the input in that case.
+ */
+static int w_terminate(struct wkt *wkt)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t len = wkt->input_len;
+    char *buf;
+
+    if (wkt->map == NULL || (len % page) != 0) {
+        return 0;
+    }
+
+    buf = malloc(len + 1);
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memcpy(buf, wkt->input, len);
+    buf[len] = 0;
+
+    wkt_unmap(wkt);
+    wkt->buffer = buf;
+    wkt->input = buf;
+    wkt->input_len = len;
+
+    return 0;
+}
+
+/* Binary formats are recognized whatever reader was asked for. */
+static wkt_io_t w_detect(const struct wkt *wkt)
+{
+    if (wkt->input_len >= sizeof(struct wkt_columnar) &&
+        !memcmp(wkt->input, WKT_COLUMNAR_MAGIC, sizeof(WKT_COLUMNAR_MAGIC)-1)) {
+        return WKT_IO_COLUMNAR;
+    }
+
+    if (wkt->input_len >= sizeof(WKT_FGB_MAGIC) &&
+        !memcmp(wkt->input, WKT_FGB_MAGIC, sizeof(WKT_FGB_MAGIC)-1)) {
+        return WKT_IO_FGB;
+    }
+
+    return wkt->reader;
+}
+
 int wkt_read(struct wkt *wkt, const char *file)
 {
     int err = 1;
+    uint64_t start;
+
+    /* a session may be reading its next document */
+    wkt_reset(wkt);
 
     err = wkt_snag(wkt, file);
 
@@ -17,8 +72,22 @@ int wkt_read(struct wkt *wkt, const char *file)
         wkt->reader = WKT_IO_NONE;
     }
 
-    switch (wkt->reader) {
+    start = wkt_stats_begin(WKT_PHASE_READ);
+
+    switch (err ? WKT_IO_NONE : w_detect(wkt)) {
     case WKT_IO_ASCII:
+        err = wkt_read_points(wkt);
+        if (!err) {
+            break;
+        }
+        err = w_terminate(wkt);
+        if (err) {
+            break;
+        }
+        if (wkt->threads > 1) {
+            err = wkt_read_parallel(wkt);
+            break;
+        }
         wkt->geom = GEOSWKTReader_read_r(wkt->handle, wkt->wktr, wkt->input);
         err = (wkt->geom == NULL);
         break;
@@ -38,10 +107,26 @@ int wkt_read(struct wkt *wkt, const char *file)
             wkt->input_len);
         err = (wkt->geom == NULL);
         break;
+    case WKT_IO_COLUMNAR:
+        err = wkt_read_columnar(wkt);
+        break;
+    case WKT_IO_FGB:
+        err = wkt_read_fgb(wkt);
+        break;
     default:
         err = 1;
         break;
     }
 
+    wkt_stats_phase(WKT_PHASE_READ, start);
+    if (!err) {
+        wkt_stats_parsed(wkt, wkt->geom);
+    }
+
+    /* The text is no longer needed once parsed. Columns stay put. */
+    if (!wkt->flat.mapped) {
+        wkt_unmap(wkt);
+    }
+
     return err;
 }
@@ -0,0 +1,109 @@
+/*
+   wkt_read_columnar.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "wkt.h"
+
+/* Check that a column lies inside the input and is 8 byte aligned. */
+static int w_column(
+    const struct wkt *wkt,
+    uint64_t offset,
+    uint64_t count,
+    size_t size)
+{
+    uint64_t len = wkt->input_len;
+
+    return (offset % 8) == 0 &&
+        offset <= len &&
+        count <= (len - offset) / size;
+}
+
+/*
+ * Point wkt->flat at the columns of a columnar file. Nothing is
+ * parsed or copied; the input stays mapped until the flat arrays are
+ * dropped.
+ */
+int wkt_read_columnar(struct wkt *wkt)
+{
+    int err = 1;
+    struct wkt_columnar hdr;
+    struct wkt_flat flat;
+    size_t node = 0;
+    size_t coords = 0;
+    int has_z;
+    int has_m;
+
+    memset(&flat, 0, sizeof(flat));
+
+    do {
+        if (wkt->input_len < sizeof(hdr)) {
+            fprintf(stderr, "Truncated columnar header\n");
+            break;
+        }
+
+        memcpy(&hdr, wkt->input, sizeof(hdr));
+
+        if (memcmp(hdr.magic, WKT_COLUMNAR_MAGIC, sizeof(hdr.magic))) {
+            fprintf(stderr, "Not a columnar file\n");
+            break;
+        }
+
+        has_z = (hdr.flags & WKT_COLUMNAR_Z) != 0;
+        has_m = (hdr.flags & WKT_COLUMNAR_M) != 0;
+        if (hdr.version != WKT_COLUMNAR_VERSION ||
+            (hdr.flags & ~(WKT_COLUMNAR_Z|WKT_COLUMNAR_M)) ||
+            hdr.dims != (uint32_t)(2 + has_z + has_m)) {
+            fprintf(stderr, "Unsupported columnar version %u dims %u\n",
+                    hdr.version, hdr.dims);
+            break;
+        }
+
+        if (!w_column(wkt, hdr.type_offset, hdr.nodes, sizeof(int32_t)) ||
+            !w_column(wkt, hdr.count_offset, hdr.nodes, sizeof(uint32_t)) ||
+            !w_column(wkt, hdr.x_offset, hdr.coords, sizeof(double)) ||
+            !w_column(wkt, hdr.y_offset, hdr.coords, sizeof(double)) ||
+            (has_z &&
+             !w_column(wkt, hdr.z_offset, hdr.coords, sizeof(double))) ||
+            (has_m &&
+             !w_column(wkt, hdr.m_offset, hdr.coords, sizeof(double))) ||
+            hdr.nodes == 0) {
+            fprintf(stderr, "Corrupt columnar file\n");
+            break;
+        }
+
+        flat.type = hdr.type;
+        flat.mapped = 1;
+        flat.n = hdr.coords;
+        flat.nodes = hdr.nodes;
+        flat.node_type = (const int32_t *)(wkt->input + hdr.type_offset);
+        flat.node_count = (const uint32_t *)(wkt->input + hdr.count_offset);
+        flat.x = (const double *)(wkt->input + hdr.x_offset);
+        flat.y = (const double *)(wkt->input + hdr.y_offset);
+        if (has_z) {
+            flat.z = (const double *)(wkt->input + hdr.z_offset);
+        }
+        if (has_m) {
+            flat.m = (const double *)(wkt->input + hdr.m_offset);
+        }
+
+        /* one tree, using every node and coordinate */
+        if (wkt_flat_subtree(&flat, &node, &coords)) {
+            break;
+        }
+        if (node != flat.nodes || coords != flat.n) {
+            fprintf(stderr, "Corrupt columnar node tree\n");
+            break;
+        }
+
+        wkt->flat = flat;
+        err = 0;
+
+    } while (0);
+
+    return err;
+}
@@ -0,0 +1,286 @@
+/*
+   wkt_read_parallel.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "wkt.h"
+
+/*
+ * Parse a top level WKT GEOMETRYCOLLECTION on several threads. The
+ * mapped text is split on member boundaries, members are handed out
+ * to workers in chunks, and each worker parses with its own GEOS
+ * context and reader. The parsed members are then gathered into one
+ * collection in input order. Geometries are not tied to the context
+ * that created them, so the main context can own the result.
+ */
+
+#define CHUNKS_PER_THREAD 8
+
+struct member {
+    size_t start;
+    size_t end;
+};
+
+struct job {
+    struct wkt *wkt;
+    struct member *member;
+    GEOSGeometry **geom;
+    size_t n;
+    size_t chunk;
+    size_t next; /* next chunk to hand out */
+    int failed;
+};
+
+static const char *w_skip(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p)) {
+        p++;
+    }
+
+    return p;
+}
+
+/*
+ * Find member boundaries. Returns the number of members, 0 if the
+ * input is not a non-empty XY GEOMETRYCOLLECTION and nothing else, in
+ * which case the caller should fall back to the serial reader. A
+ * Z, M or ZM collection is left to it too, since its members take
+ * their dimensions from the collection and could not be parsed alone.
+ */
+static size_t w_split(
+    const char *input,
+    size_t len,
+    struct member **member)
+{
+    static const char keyword[] = "GEOMETRYCOLLECTION";
+    const char *end = input + len;
+    const char *p = w_skip(input, end);
+    const char *start;
+    struct member *m = NULL;
+    size_t n = 0;
+    size_t size = 0;
+    int depth = 1;
+
+    if ((size_t)(end - p) < sizeof(keyword) ||
+        strncasecmp(p, keyword, sizeof(keyword)-1)) {
+        return 0;
+    }
+    p += sizeof(keyword)-1;
+
+    /* EMPTY, or a dimension word, is for the serial reader */
+    p = w_skip(p, end);
+    if (p == end || *p != '(') {
+        return 0;
+    }
+
+    start = w_skip(p + 1, end);
+    for (p = start; p < end && depth > 0; p++) {
+        int boundary = 0;
+
+        switch (*p) {
+        case '(':
+            depth++;
+            break;
+        case ')':
+            depth--;
+            boundary = (depth == 0);
+            break;
+        case ',':
+            boundary = (depth == 1);
+            break;
+        default:
+            break;
+        }
+
+        if (boundary) {
+            if (n == size) {
+                struct member *t;
+                size = size ? size * 2 : 1024;
+                t = realloc(m, size * sizeof(*m));
+                if (t == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    free(m);
+                    return 0;
+                }
+                m = t;
+            }
+            m[n].start = start - input;
+            m[n].end = p - input;
+            n++;
+            start = w_skip(p + 1, end);
+        }
+    }
+
+    if (depth != 0 || w_skip(p, end) != end) {
+        /* Let the GEOS reader report the syntax error. */
+        free(m);
+        return 0;
+    }
+
+    *member = m;
+
+    return n;
+}
+
+static void *w_worker(void *arg)
+{
+    struct job *job = arg;
+    const char *input = job->wkt->input;
+    GEOSContextHandle_t handle;
+    GEOSWKTReader *reader = NULL;
+    char *text = NULL;
+    size_t text_size = 0;
+    size_t chunk;
+    size_t i;
+    size_t end;
+    uint64_t start;
+
+    handle = GEOS_init_r();
+    if (handle == NULL) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    wkt_messages(handle);
+
+    reader = GEOSWKTReader_create_r(handle);
+    if (reader == NULL) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    while (reader && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        chunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        i = chunk * job->chunk;
+        if (i >= job->n) {
+            break;
+        }
+        end = i + job->chunk;
+        if (end > job->n) {
+            end = job->n;
+        }
+
+        start = wkt_stats_now();
+        for (; i < end; i++) {
+            const struct member *m = &job->member[i];
+            size_t len = m->end - m->start;
+
+            /* The WKT reader wants a NUL terminated string. */
+            if (len + 1 > text_size) {
+                char *t = realloc(text, len + 1);
+                if (t == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                    break;
+                }
+                text = t;
+                text_size = len + 1;
+            }
+            memcpy(text, input + m->start, len);
+            text[len] = 0;
+
+            job->geom[i] = GEOSWKTReader_read_r(handle, reader, text);
+            if (job->geom[i] == NULL) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        wkt_stats_trace("parse chunk", start);
+    }
+
+    free(text);
+    if (reader) {
+        GEOSWKTReader_destroy_r(handle, reader);
+    }
+    GEOS_finish_r(handle);
+
+    return NULL;
+}
+
+int wkt_read_parallel(struct wkt *wkt)
+{
+    int err = 1;
+    unsigned int i;
+    unsigned int threads = wkt->threads;
+    unsigned int started = 0;
+    pthread_t *tid = NULL;
+    struct job job;
+
+    memset(&job, 0, sizeof(job));
+    job.wkt = wkt;
+
+    do {
+        job.n = w_split(wkt->input, wkt->input_len, &job.member);
+        if (job.n == 0) {
+            /* Not splittable; use the serial reader. */
+            wkt->geom = GEOSWKTReader_read_r(
+                wkt->handle, wkt->wktr, wkt->input);
+            err = (wkt->geom == NULL);
+            break;
+        }
+
+        if (threads > job.n) {
+            threads = job.n;
+        }
+
+        job.chunk = job.n / (threads * CHUNKS_PER_THREAD);
+        if (job.chunk == 0) {
+            job.chunk = 1;
+        }
+
+        job.geom = calloc(job.n, sizeof(*job.geom));
+        tid = calloc(threads, sizeof(*tid));
+        if (job.geom == NULL || tid == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+
+        for (i=0; i<threads; i++) {
+            if (pthread_create(&tid[i], NULL, w_worker, &job)) {
+                fprintf(stderr, "Could not create thread\n");
+                __atomic_store_n(&job.failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            started++;
+        }
+
+        for (i=0; i<started; i++) {
+            pthread_join(tid[i], NULL);
+        }
+
+        if (job.failed) {
+            break;
+        }
+
+        /* the collection takes ownership of the members */
+        wkt->geom = GEOSGeom_createCollection_r(
+            wkt->handle,
+            GEOS_GEOMETRYCOLLECTION,
+            job.geom,
+            job.n);
+        err = (wkt->geom == NULL);
+
+    } while (0);
+
+    if (err && job.geom) {
+        size_t n;
+        for (n=0; n<job.n; n++) {
+            if (job.geom[n]) {
+                GEOSGeom_destroy_r(wkt->handle, job.geom[n]);
+            }
+        }
+    }
+
+    free(tid);
+    free(job.geom);
+    free(job.member);
+
+    return err;
+}
@@ -0,0 +1,364 @@
+/*
+   wkt_read_points.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "wkt.h"
+
+/*
+ * Fast path for point-only WKT:
+ *
+ *   GEOMETRYCOLLECTION (POINT (x y), ...)
+ *   MULTIPOINT ((x y), ...)
+ *   MULTIPOINT (x y, ...)
+ *
+ * Coordinates are scanned straight out of the mapped input into flat
+ * x/y arrays in wkt->flat; no GEOS geometry is built until someone
+ * asks for one with wkt_geometry(). Anything else (Z/M, EMPTY, other
+ * geometry types, odd number syntax) makes this return non-zero so
+ * the caller can fall back to the GEOS reader.
+ */
+
+#define MAX_DIGITS 19 /* decimal digits that always fit in uint64_t */
+#define MAX_EXACT (((uint64_t)1) << 53)
+#define MAX_TOKEN 64
+#define RELEASE_STEP (64*1024*1024)
+
+struct scan {
+    const char *p;
+    const char *end;
+};
+
+static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define MAX_POW10 ((int)(sizeof(pow10)/sizeof(pow10[0])) - 1)
+
+static void w_ws(struct scan *s)
+{
+    while (s->p < s->end && isspace((unsigned char)*s->p)) {
+        s->p++;
+    }
+}
+
+static int w_char(struct scan *s, char c)
+{
+    w_ws(s);
+    if (s->p < s->end && *s->p == c) {
+        s->p++;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int w_word(struct scan *s, const char *word)
+{
+    size_t len = strlen(word);
+
+    w_ws(s);
+    if ((size_t)(s->end - s->p) < len || strncasecmp(s->p, word, len)) {
+        return 0;
+    }
+    if ((size_t)(s->end - s->p) > len &&
+        isalpha((unsigned char)s->p[len])) {
+        return 0;
+    }
+    s->p += len;
+
+    return 1;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/*
+ * SWAR digit handling: test and convert eight ASCII digits held in a
+ * little-endian 64 bit word at once.
+ */
+static int w_eight_digits(uint64_t v)
+{
+    return !(((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) &
+             0x8080808080808080ULL);
+}
+
+static uint64_t w_parse_eight(uint64_t v)
+{
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 0x000F424000000064ULL; /* 100 + (1000000 << 32) */
+    const uint64_t mul2 = 0x0000271000000001ULL; /* 1 + (10000 << 32) */
+
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+
+    return v;
+}
+
+static const char *w_digits8(
+    const char *p,
+    const char *end,
+    uint64_t *m,
+    int *digits)
+{
+    uint64_t v;
+
+    while (end - p >= 8 && *digits + 8 <= MAX_DIGITS) {
+        memcpy(&v, p, sizeof(v));
+        if (!w_eight_digits(v)) {
+            break;
+        }
+        *m = (*m * 100000000ULL) + w_parse_eight(v);
+        *digits += 8;
+        p += 8;
+    }
+
+    return p;
+}
+#else
+static const char *w_digits8(
+    const char *p,
+    const char *end,
+    uint64_t *m,
+    int *digits)
+{
+    (void)end;
+    (void)m;
+    (void)digits;
+    return p;
+}
+#endif
+
+/* Scan a run of digits, returning the number of digits seen. */
+static int w_digits(struct scan *s, uint64_t *m, int *digits, int *slow)
+{
+    const char *p = s->p;
+    int seen;
+
+    p = w_digits8(p, s->end, m, digits);
+
+    while (p < s->end && isdigit((unsigned char)*p)) {
+        if (*digits < MAX_DIGITS) {
+            *m = (*m * 10) + (*p - '0');
+            (*digits)++;
+        } else {
+            *slow = 1;
+        }
+        p++;
+    }
+
+    seen = p - s->p;
+    s->p = p;
+
+    return seen;
+}
+
+/*
+ * Numbers with at most 19 significant digits and a small decimal
+ * exponent are converted exactly (one correctly rounded multiply or
+ * divide of two exact doubles); anything else goes through strtod().
+ */
+static int w_number(struct scan *s, double *value)
+{
+    const char *start;
+    uint64_t m = 0;
+    int digits = 0;
+    int seen;
+    int neg = 0;
+    int exp10 = 0;
+    int slow = 0;
+    double v;
+
+    w_ws(s);
+    start = s->p;
+
+    if (s->p < s->end && (*s->p == '-' || *s->p == '+')) {
+        neg = (*s->p == '-');
+        s->p++;
+    }
+
+    seen = w_digits(s, &m, &digits, &slow);
+
+    if (s->p < s->end && *s->p == '.') {
+        int before = digits;
+        s->p++;
+        seen += w_digits(s, &m, &digits, &slow);
+        exp10 -= digits - before;
+    }
+
+    if (!seen) {
+        return 0;
+    }
+
+    if (s->p < s->end && (*s->p == 'e' || *s->p == 'E')) {
+        int eneg = 0;
+        int e = 0;
+
+        s->p++;
+        if (s->p < s->end && (*s->p == '-' || *s->p == '+')) {
+            eneg = (*s->p == '-');
+            s->p++;
+        }
+        if (s->p == s->end || !isdigit((unsigned char)*s->p)) {
+            return 0;
+        }
+        while (s->p < s->end && isdigit((unsigned char)*s->p)) {
+            if (e < 10000) {
+                e = (e * 10) + (*s->p - '0');
+            } else {
+                slow = 1;
+            }
+            s->p++;
+        }
+        exp10 += eneg ? -e : e;
+    }
+
+    if (!slow && m <= MAX_EXACT &&
+        exp10 >= -MAX_POW10 && exp10 <= MAX_POW10) {
+        v = (double)m;
+        if (exp10 < 0) {
+            v /= pow10[-exp10];
+        } else {
+            v *= pow10[exp10];
+        }
+        *value = neg ? -v : v;
+    } else {
+        char token[MAX_TOKEN];
+        size_t len = s->p - start;
+        char *endp;
+
+        if (len >= sizeof(token)) {
+            return 0;
+        }
+        memcpy(token, start, len);
+        token[len] = 0;
+        *value = strtod(token, &endp);
+        if (*endp != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+struct points {
+    double *x;
+    double *y;
+    size_t n;
+    size_t size;
+};
+
+static int w_push(struct points *pts, double x, double y)
+{
+    if (pts->n == pts->size) {
+        size_t n = pts->size ? pts->size * 2 : 1024;
+        double *px = realloc(pts->x, n * sizeof(*px));
+        double *py;
+
+        if (px == NULL) {
+            return 0;
+        }
+        pts->x = px;
+        py = realloc(pts->y, n * sizeof(*py));
+        if (py == NULL) {
+            return 0;
+        }
+        pts->y = py;
+        pts->size = n;
+    }
+
+    pts->x[pts->n] = x;
+    pts->y[pts->n] = y;
+    pts->n++;
+
+    return 1;
+}
+
+int wkt_read_points(struct wkt *wkt)
+{
+    int ok = 0;
+    int paren;
+    double x;
+    double y;
+    struct scan s;
+    struct points pts;
+    struct wkt_flat flat;
+
+    memset(&pts, 0, sizeof(pts));
+    memset(&flat, 0, sizeof(flat));
+    s.p = wkt->input;
+    s.end = wkt->input + wkt->input_len;
+
+    do {
+        if (w_word(&s, "GEOMETRYCOLLECTION")) {
+            flat.type = GEOS_GEOMETRYCOLLECTION;
+        } else if (w_word(&s, "MULTIPOINT")) {
+            flat.type = GEOS_MULTIPOINT;
+        } else {
+            break;
+        }
+
+        if (!w_char(&s, '(')) {
+            break;
+        }
+
+        do {
+            ok = 0;
+            if (flat.type == GEOS_GEOMETRYCOLLECTION) {
+                if (!w_word(&s, "POINT")) {
+                    break;
+                }
+                paren = w_char(&s, '(');
+                if (!paren) {
+                    break;
+                }
+            } else {
+                paren = w_char(&s, '(');
+            }
+
+            ok = w_number(&s, &x) && w_number(&s, &y);
+            if (ok && paren) {
+                ok = w_char(&s, ')');
+            }
+            if (ok) {
+                ok = w_push(&pts, x, y);
+            }
+            if (wkt->map &&
+                (size_t)(s.p - wkt->input) >=
+                wkt->map_released + RELEASE_STEP) {
+                /* parsed text won't be looked at again */
+                wkt_release(wkt, s.p - wkt->input);
+            }
+        } while (ok && w_char(&s, ','));
+
+        if (!ok || !w_char(&s, ')')) {
+            ok = 0;
+            break;
+        }
+
+        w_ws(&s);
+        ok = (s.p == s.end);
+
+    } while (0);
+
+    if (ok) {
+        flat.n = pts.n;
+        flat.x = pts.x;
+        flat.y = pts.y;
+        wkt->flat = flat;
+    } else {
+        free(pts.x);
+        free(pts.y);
+    }
+
+    return !ok;
+}
@@ -0,0 +1,45 @@
+/*
+   wkt_release.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/*
+ * Tell the kernel the mapped input before offset has been parsed and
+ * won't be looked at again, so a huge input doesn't push everything
+ * else out of the page cache. Returns non-zero if nothing could be
+ * released.
+ */
+int wkt_release(struct wkt *wkt, size_t offset)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = wkt->map_released;
+    size_t end;
+    char *map = wkt->map;
+
+    if (map == NULL) {
+        return 1;
+    }
+
+    if (offset > wkt->map_len) {
+        offset = wkt->map_len;
+    }
+
+    end = offset & ~(page - 1);
+    if (end <= start) {
+        return 1;
+    }
+
+    madvise(map + start, end - start, MADV_DONTNEED);
+    posix_fadvise(wkt->map_fd, start, end - start, POSIX_FADV_DONTNEED);
+
+    wkt->map_released = end;
+
+    return 0;
+}
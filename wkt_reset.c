@@ -0,0 +1,27 @@
+/*
+   wkt_reset.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+
+/*
+ * Drop the current document: geometry, flat arrays, input and cached
+ * envelopes. The GEOS context, readers and writers stay open for the
+ * next one.
+ */
+void wkt_reset(struct wkt *wkt)
+{
+    if (wkt->geom) {
+        GEOSGeom_destroy_r(wkt->handle, wkt->geom);
+        wkt->geom = NULL;
+    }
+
+    wkt_flat_free(wkt);
+
+    wkt_unmap(wkt);
+
+    wkt_forget_bounds(wkt);
+}
@@ -0,0 +1,324 @@
+/*
+   wkt_rtree.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wkt.h"
+
+/*
+ * Packed Hilbert R-tree, laid out as FlatGeobuf lays it out: one array
+ * of struct wkt_node with the root first and the leaves last, each
+ * level stored contiguously. A leaf's offset is whatever the caller
+ * put there (a feature offset or index); an interior node's offset is
+ * the array index of its first child. Every node but the last in a
+ * level has exactly node_size children.
+ */
+
+#define MAX_LEVELS 64
+#define HILBERT_MAX 0xFFFF
+
+struct levels {
+    int n;
+    size_t start[MAX_LEVELS]; /* level 0 is the leaves */
+    size_t end[MAX_LEVELS];
+};
+
+struct hilbert {
+    uint32_t h;
+    size_t i;
+};
+
+/* Returns the total number of nodes. */
+static size_t w_levels(size_t n, unsigned int node_size, struct levels *lv)
+{
+    size_t count[MAX_LEVELS];
+    size_t total = n;
+    size_t size = n;
+    int i;
+
+    lv->n = 0;
+    if (n == 0 || node_size < 2) {
+        return 0;
+    }
+
+    count[lv->n++] = size;
+    do {
+        size = (size + node_size - 1) / node_size;
+        total += size;
+        count[lv->n++] = size;
+    } while (size != 1);
+
+    size = total;
+    for (i=0; i<lv->n; i++) {
+        lv->start[i] = size - count[i];
+        lv->end[i] = size;
+        size -= count[i];
+    }
+
+    return total;
+}
+
+/* Position of a 16 bit x,y on the Hilbert curve. */
+static uint32_t w_hilbert(uint32_t x, uint32_t y)
+{
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+    uint32_t A = a | (b >> 1);
+    uint32_t B = (a >> 1) ^ a;
+    uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+    uint32_t i0;
+    uint32_t i1;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    i0 = x ^ y;
+    i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+static uint32_t w_scale(double v, double min, double width)
+{
+    if (width <= 0.0) {
+        return 0;
+    }
+
+    return (uint32_t)(HILBERT_MAX * ((v - min) / width));
+}
+
+/* Descending, as FlatGeobuf orders features. */
+static int w_compare(const void *a, const void *b)
+{
+    const struct hilbert *ha = a;
+    const struct hilbert *hb = b;
+
+    if (ha->h != hb->h) {
+        return (ha->h > hb->h) ? -1 : 1;
+    }
+
+    /* keep input order among equals */
+    return (ha->i < hb->i) ? -1 : (ha->i > hb->i);
+}
+
+/* Number of nodes in a tree over n leaves. */
+size_t wkt_rtree_nodes(size_t n, unsigned int node_size)
+{
+    struct levels lv;
+
+    return w_levels(n, node_size, &lv);
+}
+
+/* Sort leaves along the Hilbert curve through their centres. */
+int wkt_rtree_sort(struct wkt_node *leaf, size_t n)
+{
+    struct hilbert *key;
+    struct wkt_node *sorted;
+    struct wkt_node extent;
+    double width;
+    double height;
+    size_t i;
+
+    if (n < 2) {
+        return 0;
+    }
+
+    key = malloc(n * sizeof(*key));
+    sorted = malloc(n * sizeof(*sorted));
+    if (key == NULL || sorted == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(key);
+        free(sorted);
+        return 1;
+    }
+
+    extent = leaf[0];
+    for (i=1; i<n; i++) {
+        wkt_rtree_expand(&extent, &leaf[i]);
+    }
+    width = extent.maxx - extent.minx;
+    height = extent.maxy - extent.miny;
+
+    for (i=0; i<n; i++) {
+        double cx = (leaf[i].minx + leaf[i].maxx) / 2;
+        double cy = (leaf[i].miny + leaf[i].maxy) / 2;
+
+        key[i].h = w_hilbert(
+            w_scale(cx, extent.minx, width),
+            w_scale(cy, extent.miny, height));
+        key[i].i = i;
+    }
+
+    qsort(key, n, sizeof(*key), w_compare);
+
+    for (i=0; i<n; i++) {
+        sorted[i] = leaf[key[i].i];
+    }
+    memcpy(leaf, sorted, n * sizeof(*leaf));
+
+    free(sorted);
+    free(key);
+
+    return 0;
+}
+
+void wkt_rtree_expand(struct wkt_node *node, const struct wkt_node *with)
+{
+    if (with->minx < node->minx) {
+        node->minx = with->minx;
+    }
+    if (with->miny < node->miny) {
+        node->miny = with->miny;
+    }
+    if (with->maxx > node->maxx) {
+        node->maxx = with->maxx;
+    }
+    if (with->maxy > node->maxy) {
+        node->maxy = with->maxy;
+    }
+}
+
+/*
+ * Fill in the interior nodes of a tree whose sorted leaves are already
+ * in the last n slots of node[].
+ */
+void wkt_rtree_build(struct wkt_node *node, size_t n, unsigned int node_size)
+{
+    struct levels lv;
+    size_t pos;
+    size_t end;
+    size_t parent;
+    unsigned int j;
+    int i;
+
+    w_levels(n, node_size, &lv);
+
+    for (i=0; i<lv.n-1; i++) {
+        pos = lv.start[i];
+        end = lv.end[i];
+        parent = lv.start[i+1];
+        while (pos < end) {
+            struct wkt_node *p = &node[parent++];
+
+            *p = node[pos];
+            p->offset = pos;
+            for (j=1, pos++; j<node_size && pos<end; j++, pos++) {
+                wkt_rtree_expand(p, &node[pos]);
+            }
+        }
+    }
+}
+
+/*
+ * Call hit for each leaf whose box meets the query box, in leaf order.
+ * The index is read with memcpy so it may sit unaligned in a mapped
+ * file. Returns non-zero if hit does, or on error.
+ */
+int wkt_rtree_search(
+    const void *index,
+    size_t n,
+    unsigned int node_size,
+    const struct wkt_node *box,
+    int (*hit)(const struct wkt_node *leaf, size_t i, void *user_data),
+    void *user_data)
+{
+    int err = 0;
+    const unsigned char *base = index;
+    struct levels lv;
+    struct wkt_node node;
+    size_t total;
+    size_t first; /* first leaf */
+    size_t *queue;
+    int *level;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t pos;
+    size_t end;
+
+    total = w_levels(n, node_size, &lv);
+    if (total == 0) {
+        return 0;
+    }
+    first = total - n;
+
+    /* every interior node is queued at most once */
+    queue = malloc((first + 1) * sizeof(*queue));
+    level = malloc((first + 1) * sizeof(*level));
+    if (queue == NULL || level == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(queue);
+        free(level);
+        return 1;
+    }
+
+    queue[tail] = 0;
+    level[tail++] = lv.n - 1;
+
+    while (!err && head < tail) {
+        int l = level[head];
+
+        pos = queue[head++];
+        end = pos + node_size;
+        if (end > lv.end[l]) {
+            end = lv.end[l];
+        }
+
+        for (; !err && pos<end; pos++) {
+            memcpy(&node, base + pos * sizeof(node), sizeof(node));
+            if (node.maxx < box->minx || node.maxy < box->miny ||
+                node.minx > box->maxx || node.miny > box->maxy) {
+                continue;
+            }
+            if (pos >= first) {
+                err = hit(&node, pos - first, user_data);
+            } else if (node.offset < lv.start[l-1] ||
+                       node.offset >= lv.end[l-1] ||
+                       tail > first) {
+                fprintf(stderr, "Corrupt spatial index\n");
+                err = 1;
+            } else {
+                queue[tail] = node.offset;
+                level[tail++] = l - 1;
+            }
+        }
+    }
+
+    free(level);
+    free(queue);
+
+    return err;
+}
@@ -0,0 +1,33 @@
+/*
+   wkt_scratch.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wkt.h"
+
+/*
+ * Room for n doubles in wkt->scratch, which is kept from call to call
+ * and freed by wkt_close(). NULL if it cannot be had. There is only
+ * one, so whoever asked for it last owns it: iterators that hand it
+ * to a handler cannot be nested inside that handler.
+ */
+double *wkt_scratch(struct wkt *wkt, size_t n)
+{
+    double *scratch;
+
+    if (n > wkt->scratch_size) {
+        scratch = realloc(wkt->scratch, n * sizeof(*scratch));
+        if (scratch == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return NULL;
+        }
+        wkt->scratch = scratch;
+        wkt->scratch_size = n;
+    }
+
+    return wkt->scratch;
+}
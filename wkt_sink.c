@@ -0,0 +1,205 @@
+/*
+   wkt_sink.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+/*
+ * Buffered output: data is gathered in a fixed size buffer and
+ * written out as it fills, so serialized output never has to exist
+ * in one piece. Short writes are resumed. After the first error the
+ * sink drops everything and wkt_sink_close() reports it.
+ *
+ * A memory sink has no file; its buffer grows to hold everything
+ * written, for the owner to take from buf and len before closing.
+ */
+
+#define MEMORY_MIN 4096
+#define IOV_CALL 64 /* vectors per writev(), well under any IOV_MAX */
+
+static int w_flush(struct wkt_sink *sink, const char *data, size_t len)
+{
+    ssize_t n;
+
+    while (!sink->err && len) {
+        n = write(sink->fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "%s: %s\n", sink->name,
+                    n ? strerror(errno) : "truncated");
+            sink->err = 1;
+            break;
+        }
+        wkt_stats_count(WKT_STAT_BYTES_WRITTEN, n);
+        data += n;
+        len -= n;
+    }
+
+    return sink->err;
+}
+
+/* NULL or "-" is stdout. */
+int wkt_sink_open(struct wkt_sink *sink, const char *file)
+{
+    memset(sink, 0, sizeof(*sink));
+
+    if (file == NULL || !strcmp(file, "-")) {
+        sink->fd = STDOUT_FILENO;
+        sink->name = "<stdout>";
+    } else {
+        sink->fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        sink->name = file;
+        sink->opened = 1;
+    }
+
+    if (sink->fd < 0) {
+        fprintf(stderr, "%s: %s\n", sink->name, strerror(errno));
+        sink->err = 1;
+        return 1;
+    }
+
+    sink->buf = malloc(WKT_SINK_SIZE);
+    if (sink->buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        sink->err = 1;
+    }
+
+    return sink->err;
+}
+
+int wkt_sink_memory(struct wkt_sink *sink)
+{
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = -1;
+    sink->name = "<memory>";
+    sink->memory = 1;
+
+    return 0;
+}
+
+static int w_grow(struct wkt_sink *sink, size_t len)
+{
+    size_t size = sink->size ? sink->size : MEMORY_MIN;
+    char *buf;
+
+    while (size < sink->len + len) {
+        size *= 2;
+    }
+
+    buf = realloc(sink->buf, size);
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        sink->err = 1;
+        return 1;
+    }
+    sink->buf = buf;
+    sink->size = size;
+
+    return 0;
+}
+
+int wkt_sink_write(struct wkt_sink *sink, const void *data, size_t len)
+{
+    if (sink->err) {
+        return 1;
+    }
+
+    if (sink->memory) {
+        if (sink->len + len > sink->size && w_grow(sink, len)) {
+            return 1;
+        }
+        memcpy(sink->buf + sink->len, data, len);
+        sink->len += len;
+        return 0;
+    }
+
+    if (sink->len + len > WKT_SINK_SIZE) {
+        w_flush(sink, sink->buf, sink->len);
+        sink->len = 0;
+    }
+
+    if (len >= WKT_SINK_SIZE) {
+        /* no point copying it */
+        return w_flush(sink, data, len);
+    }
+
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+
+    return sink->err;
+}
+
+/*
+ * Write out what is buffered, then the vectors with as few system
+ * calls as the kernel allows. The vectors are consumed.
+ */
+int wkt_sink_writev(struct wkt_sink *sink, struct iovec *iov, int n)
+{
+    ssize_t done;
+
+    if (sink->err || sink->memory) {
+        return 1;
+    }
+
+    w_flush(sink, sink->buf, sink->len);
+    sink->len = 0;
+
+    while (!sink->err && n > 0) {
+        done = writev(sink->fd, iov, n < IOV_CALL ? n : IOV_CALL);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            fprintf(stderr, "%s: %s\n", sink->name,
+                    done ? strerror(errno) : "truncated");
+            sink->err = 1;
+            break;
+        }
+        wkt_stats_count(WKT_STAT_BYTES_WRITTEN, done);
+
+        /* skip what went out, part of a vector included */
+        while (n > 0 && (size_t)done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return sink->err;
+}
+
+/* Flush and close; returns non-zero if anything went wrong. */
+int wkt_sink_close(struct wkt_sink *sink)
+{
+    if (sink->buf) {
+        if (!sink->memory) {
+            w_flush(sink, sink->buf, sink->len);
+        }
+        free(sink->buf);
+        sink->buf = NULL;
+    }
+
+    if (sink->opened && sink->fd >= 0 && close(sink->fd)) {
+        fprintf(stderr, "%s: %s\n", sink->name, strerror(errno));
+        sink->err = 1;
+    }
+    sink->fd = -1;
+
+    return sink->err;
+}
@@ -0,0 +1,205 @@
+/*
+   wkt_source.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#define MAGIC_LEN 6
+#define SMALL_INPUT (64*1024) /* read, not mapped, up to this size */
+
+/* Read the magic number from a descriptor that cannot seek back. */
+static ssize_t w_sniff(int fd, unsigned char *magic, size_t len)
+{
+    size_t have = 0;
+    ssize_t n;
+
+    while (have < len) {
+        n = read(fd, magic + have, len - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return n;
+        }
+        if (n == 0) {
+            break;
+        }
+        have += n;
+    }
+
+    return have;
+}
+
+/*
+ * Small files are cheaper to read than to map and unmap. They go into
+ * wkt->small, which is kept from one document to the next and NUL
+ * terminated like a slurped feed.
+ */
+static int w_small(struct wkt *wkt, int fd, const char *file)
+{
+    size_t len = wkt->input_len;
+    size_t have = 0;
+    ssize_t n;
+    char *buf;
+
+    if (len + 1 > wkt->small_size) {
+        buf = realloc(wkt->small, SMALL_INPUT + 1);
+        if (buf == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        wkt->small = buf;
+        wkt->small_size = SMALL_INPUT + 1;
+    }
+
+    while (have < len) {
+        n = pread(fd, wkt->small + have, len - have, have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "%s: %s\n", file,
+                    n ? strerror(errno) : "truncated");
+            return 1;
+        }
+        have += n;
+    }
+    wkt->small[len] = 0;
+    wkt->input = wkt->small;
+    wkt_stats_count(WKT_STAT_BYTES_READ, len);
+
+    return 0;
+}
+
+/*
+ * Attach input: plain files are mapped into wkt->input, compressed
+ * files, pipes and other unmappable descriptors get a wkt->feed
+ * instead. "-" is stdin.
+ */
+int wkt_source(struct wkt *wkt, const char *file)
+{
+    int err = 1;
+    int fd;
+    struct stat stat;
+    unsigned char magic[MAGIC_LEN];
+    ssize_t n;
+    wkt_z_t z;
+    int flags;
+    void *map;
+
+    /* drop whatever was attached before */
+    wkt_unmap(wkt);
+
+    do {
+        if (!strcmp(file, "-")) {
+            fd = STDIN_FILENO;
+            file = "<stdin>";
+        } else {
+            fd = open(file, O_RDONLY);
+        }
+        /* open */
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", file, strerror(errno));
+            break;
+        }
+
+        /* fstat */
+        err = fstat(fd, &stat);
+
+        if (err) {
+            fprintf(stderr, "%s: %s\n", file, strerror(errno));
+            break;
+        }
+
+        if (!S_ISREG(stat.st_mode)) {
+            /* pipe: the magic bytes are consumed, so pass them on */
+            n = w_sniff(fd, magic, sizeof(magic));
+            if (n < 0) {
+                fprintf(stderr, "%s: %s\n", file, strerror(errno));
+                err = 1;
+                break;
+            }
+            z = wkt_feed_detect(magic, n);
+            err = wkt_feed_open(wkt, fd, z, magic, n, file);
+            fd = -1; /* owned by the feed now */
+            break;
+        }
+
+        /* compressed? */
+        n = pread(fd, magic, sizeof(magic), 0);
+        z = wkt_feed_detect(magic, (n > 0) ? (size_t)n : 0);
+        if (z != WKT_Z_NONE) {
+            err = wkt_feed_open(wkt, fd, z, NULL, 0, file);
+            fd = -1; /* owned by the feed now */
+            break;
+        }
+
+        wkt->input_len = stat.st_size;
+        if (wkt->input_len == 0) {
+            /* nothing to map */
+            wkt->input = "";
+            break;
+        }
+
+        if (wkt->input_len <= SMALL_INPUT) {
+            err = w_small(wkt, fd, file);
+            break;
+        }
+
+        /* mmap */
+        flags = MAP_PRIVATE;
+        if (wkt->map_flags & WKT_MAP_POPULATE) {
+            flags |= MAP_POPULATE;
+        }
+        map = mmap(
+            NULL,
+            wkt->input_len,
+            PROT_READ,
+            flags,
+            fd,
+            0);
+
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", file, strerror(errno));
+            err = -1;
+            break;
+        }
+
+        /* Input is parsed front to back, once. */
+        madvise(map, wkt->input_len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        if (wkt->map_flags & WKT_MAP_HUGEPAGE) {
+            madvise(map, wkt->input_len, MADV_HUGEPAGE);
+        }
+#endif
+        posix_fadvise(fd, 0, wkt->input_len, POSIX_FADV_SEQUENTIAL);
+
+        wkt->input = map;
+        wkt->map = map;
+        wkt->map_len = wkt->input_len;
+        wkt->map_released = 0;
+        wkt->map_fd = fd;
+        fd = -1; /* kept for wkt_release() */
+        wkt_stats_count(WKT_STAT_BYTES_MAPPED, wkt->map_len);
+        wkt_stats_mapped(wkt->map_len);
+
+    } while (0);
+
+    if (fd >= 0 && fd != STDIN_FILENO) {
+        close(fd); /* fd not needed any more */
+    }
+
+    return err;
+}
@@ -0,0 +1,561 @@
+/*
+   wkt_stats.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "wkt.h"
+
+/*
+ * Phase timers and counters for the whole process, off until
+ * wkt_stats_enable(). Every context and thread adds to the same
+ * totals, so worker threads need no setup. Times are wall clock from
+ * CLOCK_MONOTONIC; a phase run on several threads at once adds up the
+ * time of each.
+ *
+ * With a trace file named, timed spans are also kept as Chrome trace
+ * events, one row per thread, and written out by wkt_stats_report().
+ *
+ * With wkt_stats_memory() allocations are accounted too, by an
+ * allocator the program provides calling wkt_stats_alloc() and
+ * wkt_stats_free(); see wktalloc.c. A block is charged to the phase
+ * begun last by wkt_stats_begin() and not yet ended, or to "other",
+ * and its free is credited back to that phase whenever it happens, so
+ * what a phase still holds is known at any time. Blocks are kept in a
+ * table of their own, in memory that is mapped rather than allocated;
+ * blocks from before accounting began are not in it, and their frees
+ * are not counted. Sizes are what malloc_usable_size() says. Phases
+ * are begun and ended on one thread at a time, but allocations on any
+ * thread are charged to the current one.
+ */
+
+#define EVENTS_MIN 1024
+#define PHASE_DEPTH 8
+#define PHASE_OTHER WKT_PHASE_COUNT
+#define SHARDS 64 /* block table locks */
+#define SLOTS_MIN 4096
+
+struct event {
+    const char *name;
+    uint64_t start;
+    uint64_t dur;
+    unsigned int tid;
+};
+
+/* blocks allocated while a phase was current */
+struct mem {
+    uint64_t allocated;
+    uint64_t freed;
+    uint64_t allocations;
+    int64_t live;
+    int64_t peak;
+};
+
+/* a live block, or an empty slot when ptr is 0 */
+struct block {
+    uintptr_t ptr;
+    size_t size;
+    unsigned int phase;
+};
+
+/* one part of the block table, open addressed with linear probing */
+struct shard {
+    pthread_mutex_t lock;
+    struct block *slot;
+    size_t size; /* a power of 2 */
+    size_t used;
+};
+
+static const char *w_phase_name[WKT_PHASE_COUNT + 1] = {
+    "snag",
+    "read",
+    "compute",
+    "write",
+    "plot",
+    "other",
+};
+
+static const char *w_stat_name[WKT_STAT_COUNT] = {
+    "bytes_mapped",
+    "bytes_read",
+    "geometries",
+    "vertices",
+    "bytes_written",
+    "primitives",
+};
+
+static struct {
+    int on;
+    const char *trace;
+    uint64_t epoch;
+    uint64_t ns[WKT_PHASE_COUNT];
+    uint64_t calls[WKT_PHASE_COUNT];
+    uint64_t count[WKT_STAT_COUNT];
+    unsigned int threads;
+    pthread_mutex_t lock;
+    struct event *event;
+    size_t events;
+    size_t size;
+    int memory;
+    unsigned int current;
+    int depth;
+    unsigned int stack[PHASE_DEPTH];
+    int64_t live;
+    int64_t peak;
+    int64_t mapped;
+    int64_t mapped_peak;
+    struct mem mem[WKT_PHASE_COUNT + 1];
+    struct shard shard[SHARDS];
+} stats = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .current = PHASE_OTHER,
+};
+
+static __thread unsigned int w_tid;
+
+static uint64_t w_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Numbered in order of first event, the calling thread first. */
+static unsigned int w_thread(void)
+{
+    if (w_tid == 0) {
+        w_tid = __atomic_add_fetch(&stats.threads, 1, __ATOMIC_RELAXED);
+    }
+
+    return w_tid;
+}
+
+/*
+ * Start recording, and keep trace events for trace if it is not NULL.
+ * Call before any work is started.
+ */
+void wkt_stats_enable(const char *trace)
+{
+    stats.on = 1;
+    stats.trace = trace;
+    stats.epoch = w_clock();
+    w_thread();
+}
+
+/*
+ * Account for allocations as well, charged to phases. Call after
+ * wkt_stats_enable().
+ */
+void wkt_stats_memory(void)
+{
+    int i;
+
+    for (i=0; i<SHARDS; i++) {
+        pthread_mutex_init(&stats.shard[i].lock, NULL);
+    }
+    stats.memory = stats.on;
+}
+
+static void w_max(int64_t *peak, int64_t n)
+{
+    int64_t p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (n > p && !__atomic_compare_exchange_n(
+               peak, &p, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* p is reloaded */
+    }
+}
+
+/* Start of a timed span, 0 when stats are off. */
+uint64_t wkt_stats_now(void)
+{
+    return stats.on ? w_clock() : 0;
+}
+
+/*
+ * Start of a span of phase, 0 when stats are off. Allocations are
+ * charged to phase until wkt_stats_add() or wkt_stats_phase() ends it,
+ * and then to whatever phase it interrupted.
+ */
+uint64_t wkt_stats_begin(wkt_phase_t phase)
+{
+    if (!stats.on) {
+        return 0;
+    }
+
+    if (stats.depth < PHASE_DEPTH) {
+        stats.stack[stats.depth++] = stats.current;
+        __atomic_store_n(&stats.current, phase, __ATOMIC_RELAXED);
+    }
+
+    return w_clock();
+}
+
+/* Add the time since start to phase, without a trace event. */
+void wkt_stats_add(wkt_phase_t phase, uint64_t start)
+{
+    if (start == 0) {
+        return;
+    }
+
+    if (stats.depth > 0 && stats.current == (unsigned int)phase) {
+        __atomic_store_n(&stats.current, stats.stack[--stats.depth],
+                         __ATOMIC_RELAXED);
+    }
+
+    __atomic_add_fetch(&stats.ns[phase], w_clock() - start,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.calls[phase], 1, __ATOMIC_RELAXED);
+}
+
+/* A span named name from start to now, on the trace only. */
+void wkt_stats_trace(const char *name, uint64_t start)
+{
+    uint64_t end;
+    struct event *e;
+
+    if (start == 0 || stats.trace == NULL) {
+        return;
+    }
+    end = w_clock();
+
+    pthread_mutex_lock(&stats.lock);
+    if (stats.events == stats.size) {
+        size_t size = stats.size ? 2 * stats.size : EVENTS_MIN;
+        e = realloc(stats.event, size * sizeof(*e));
+        if (e == NULL) {
+            /* the trace loses events, the totals are still right */
+            pthread_mutex_unlock(&stats.lock);
+            return;
+        }
+        stats.event = e;
+        stats.size = size;
+    }
+    e = &stats.event[stats.events++];
+    e->name = name;
+    e->start = start;
+    e->dur = end - start;
+    e->tid = w_thread();
+    pthread_mutex_unlock(&stats.lock);
+}
+
+/* wkt_stats_add() and a trace event named for the phase. */
+void wkt_stats_phase(wkt_phase_t phase, uint64_t start)
+{
+    wkt_stats_add(phase, start);
+    wkt_stats_trace(w_phase_name[phase], start);
+}
+
+void wkt_stats_count(wkt_stat_t stat, uint64_t n)
+{
+    if (stats.on) {
+        __atomic_add_fetch(&stats.count[stat], n, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Count the top level members and coordinates of geom as parsed, or
+ * of the flat arrays when geom is NULL.
+ */
+void wkt_stats_parsed(struct wkt *wkt, const GEOSGeometry *geom)
+{
+    const struct wkt_flat *flat = &wkt->flat;
+    int n;
+
+    if (!stats.on) {
+        return;
+    }
+
+    if (geom) {
+        n = GEOSGetNumGeometries_r(wkt->handle, geom);
+        wkt_stats_count(WKT_STAT_GEOMETRIES, n > 0 ? n : 0);
+        n = GEOSGetNumCoordinates_r(wkt->handle, geom);
+        wkt_stats_count(WKT_STAT_VERTICES, n > 0 ? n : 0);
+        return;
+    }
+
+    if (flat->nodes == 0) {
+        wkt_stats_count(WKT_STAT_GEOMETRIES, flat->n);
+    } else if (flat->node_type[0] >= GEOS_MULTIPOINT) {
+        wkt_stats_count(WKT_STAT_GEOMETRIES, flat->node_count[0]);
+    } else {
+        wkt_stats_count(WKT_STAT_GEOMETRIES, 1);
+    }
+    wkt_stats_count(WKT_STAT_VERTICES, flat->n);
+}
+
+/* Input mapped, or unmapped when bytes is negative. */
+void wkt_stats_mapped(int64_t bytes)
+{
+    if (stats.on) {
+        w_max(&stats.mapped_peak,
+              __atomic_add_fetch(&stats.mapped, bytes, __ATOMIC_RELAXED));
+    }
+}
+
+static uint64_t w_hash(uintptr_t ptr)
+{
+    return (uint64_t)(ptr >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static struct shard *w_shard(uintptr_t ptr)
+{
+    return &stats.shard[(w_hash(ptr) >> 58) % SHARDS];
+}
+
+static struct block *w_slot(const struct shard *shard, uintptr_t ptr)
+{
+    size_t i = w_hash(ptr) & (shard->size - 1);
+
+    while (shard->slot[i].ptr && shard->slot[i].ptr != ptr) {
+        i = (i + 1) & (shard->size - 1);
+    }
+
+    return &shard->slot[i];
+}
+
+/* Double the slots, kept under 3/4 full. Mapped, not allocated. */
+static int w_grow(struct shard *shard)
+{
+    struct block *old = shard->slot;
+    size_t n = shard->size;
+    size_t size = n ? 2 * n : SLOTS_MIN;
+    void *map;
+    size_t i;
+
+    map = mmap(NULL, size * sizeof(*old), PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return 1;
+    }
+
+    shard->slot = map;
+    shard->size = size;
+    for (i=0; i<n; i++) {
+        if (old[i].ptr) {
+            *w_slot(shard, old[i].ptr) = old[i];
+        }
+    }
+    if (old) {
+        munmap(old, n * sizeof(*old));
+    }
+
+    return 0;
+}
+
+/* Take slot i out, moving up any later entries that probed past it. */
+static void w_remove(struct shard *shard, size_t i)
+{
+    size_t mask = shard->size - 1;
+    size_t j = i;
+    size_t k;
+
+    for (;;) {
+        shard->slot[i].ptr = 0;
+        do {
+            j = (j + 1) & mask;
+            if (shard->slot[j].ptr == 0) {
+                return;
+            }
+            k = w_hash(shard->slot[j].ptr) & mask;
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        shard->slot[i] = shard->slot[j];
+        i = j;
+    }
+}
+
+/* ptr was just allocated. */
+void wkt_stats_alloc(void *ptr)
+{
+    struct shard *shard;
+    struct block *b;
+    struct mem *m;
+    unsigned int phase;
+    size_t size;
+    int64_t live;
+
+    if (!stats.memory || ptr == NULL) {
+        return;
+    }
+
+    size = malloc_usable_size(ptr);
+    phase = __atomic_load_n(&stats.current, __ATOMIC_RELAXED);
+    shard = w_shard((uintptr_t)ptr);
+
+    pthread_mutex_lock(&shard->lock);
+    if (4 * (shard->used + 1) > 3 * shard->size && w_grow(shard)) {
+        /* untracked, and its free will not be counted either */
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+    b = w_slot(shard, (uintptr_t)ptr);
+    b->ptr = (uintptr_t)ptr;
+    b->size = size;
+    b->phase = phase;
+    shard->used++;
+    pthread_mutex_unlock(&shard->lock);
+
+    m = &stats.mem[phase];
+    __atomic_add_fetch(&m->allocated, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m->allocations, 1, __ATOMIC_RELAXED);
+    w_max(&m->peak, __atomic_add_fetch(&m->live, size, __ATOMIC_RELAXED));
+    live = __atomic_add_fetch(&stats.live, size, __ATOMIC_RELAXED);
+    w_max(&stats.peak, live);
+}
+
+/* ptr is about to be freed; the phase that allocated it gets it back. */
+void wkt_stats_free(void *ptr)
+{
+    struct shard *shard;
+    struct block *b;
+    struct mem *m;
+    size_t size = 0;
+    unsigned int phase = 0;
+
+    if (!stats.memory || ptr == NULL) {
+        return;
+    }
+
+    shard = w_shard((uintptr_t)ptr);
+    pthread_mutex_lock(&shard->lock);
+    if (shard->size) {
+        b = w_slot(shard, (uintptr_t)ptr);
+        if (b->ptr) {
+            size = b->size;
+            phase = b->phase;
+            w_remove(shard, b - shard->slot);
+            shard->used--;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (size == 0) {
+        return; /* from before accounting, or untracked */
+    }
+
+    m = &stats.mem[phase];
+    __atomic_add_fetch(&m->freed, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&m->live, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.live, size, __ATOMIC_RELAXED);
+}
+
+/*
+ * Per phase, the blocks allocated while it was current: how much was
+ * allocated and since freed, what is still live, and the most that
+ * was live at once.
+ */
+static void w_memory(void)
+{
+    const struct mem *m;
+    int i;
+
+    fprintf(stderr, ",\"memory\":{\"live_bytes\":%lld,\"peak_bytes\":%lld,"
+            "\"mapped_peak_bytes\":%lld,\"phases\":{",
+            (long long)stats.live, (long long)stats.peak,
+            (long long)stats.mapped_peak);
+    for (i=0; i<=WKT_PHASE_COUNT; i++) {
+        m = &stats.mem[i];
+        fprintf(stderr, "%s\"%s\":{\"allocated_bytes\":%llu,"
+                "\"freed_bytes\":%llu,\"allocations\":%llu,"
+                "\"live_bytes\":%lld,\"peak_bytes\":%lld}",
+                i ? "," : "", w_phase_name[i],
+                (unsigned long long)m->allocated,
+                (unsigned long long)m->freed,
+                (unsigned long long)m->allocations,
+                (long long)m->live, (long long)m->peak);
+    }
+    fprintf(stderr, "}}");
+}
+
+static int w_trace(void)
+{
+    FILE *f = fopen(stats.trace, "w");
+    size_t i;
+    int pid = getpid();
+
+    if (f == NULL) {
+        perror(stats.trace);
+        return 1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (i=0; i<stats.events; i++) {
+        const struct event *e = &stats.event[i];
+        fprintf(f, "{\"name\":\"%s\",\"cat\":\"wkt\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u},\n",
+                e->name, (e->start - stats.epoch) / 1e3, e->dur / 1e3,
+                pid, e->tid);
+    }
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"libwkt\"}}\n", pid);
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (fclose(f)) {
+        perror(stats.trace);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Print the totals as one JSON object on stderr and write the trace,
+ * if one was asked for. Does nothing when stats are off.
+ */
+int wkt_stats_report(void)
+{
+    int err = 0;
+    struct rusage ru;
+    long rss = 0;
+    int i;
+
+    if (!stats.on) {
+        return err;
+    }
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        rss = ru.ru_maxrss; /* in kilobytes */
+    }
+
+    fprintf(stderr, "{\"wall_seconds\":%.6f,\"phases\":{",
+            (w_clock() - stats.epoch) / 1e9);
+    for (i=0; i<WKT_PHASE_COUNT; i++) {
+        fprintf(stderr, "%s\"%s\":{\"seconds\":%.6f,\"calls\":%llu}",
+                i ? "," : "", w_phase_name[i], stats.ns[i] / 1e9,
+                (unsigned long long)stats.calls[i]);
+    }
+    fprintf(stderr, "},\"counters\":{");
+    for (i=0; i<WKT_STAT_COUNT; i++) {
+        fprintf(stderr, "%s\"%s\":%llu", i ? "," : "", w_stat_name[i],
+                (unsigned long long)stats.count[i]);
+    }
+    fprintf(stderr, "},\"peak_rss_bytes\":%llu",
+            (unsigned long long)rss * 1024);
+    if (stats.memory) {
+        w_memory();
+    }
+    fprintf(stderr, "}\n");
+
+    if (stats.trace) {
+        err = w_trace();
+    }
+
+    free(stats.event);
+    stats.event = NULL;
+    stats.events = 0;
+    stats.size = 0;
+
+    return err;
+}
@@ -0,0 +1,501 @@
+/*
+   wkt_stream.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "wkt.h"
+
+/*
+ * Record input: one geometry per line for WKT and WKB HEX, or a
+ * little-endian 32 bit byte count followed by that many bytes of WKB
+ * for binary input. Each record is parsed, handed to the iterator
+ * member by member just like wkt_iterate(), and destroyed before the
+ * next record is read, so memory use tracks the largest record rather
+ * than the input size.
+ *
+ * Mapped input is walked in place. Decoded input from a feed is pulled
+ * through a window that grows to hold the largest record.
+ *
+ * wkt_stream_split() does the same for a single WKT document: the
+ * members of a top level GEOMETRYCOLLECTION or MULTI* type become the
+ * records, so a huge collection never has to be parsed in one piece.
+ */
+
+#define WINDOW_MIN (1024*1024)
+#define RELEASE_STEP (64*1024*1024)
+#define MORE 2 /* record continues past the window */
+#define MAX_WORD 32
+
+enum {
+    SPLIT_HEAD,  /* document type not seen yet */
+    SPLIT_BODY,  /* between members */
+    SPLIT_WHOLE, /* not a collection, the document is the record */
+    SPLIT_DONE,
+};
+
+struct stream {
+    const char *next;
+    const char *end;
+    int eof;
+    int split;
+    int state;
+    char prefix[2 * MAX_WORD]; /* member type of a MULTI* document */
+    char *window;
+    size_t window_size;
+    char *line;
+    size_t line_size;
+};
+
+/* Slide the unread part of the window down and read more. */
+static int w_fill(struct wkt *wkt, struct stream *s)
+{
+    size_t len = s->end - s->next;
+    ssize_t n;
+
+    if (s->next != s->window) {
+        memmove(s->window, s->next, len);
+    }
+
+    if (len == s->window_size) {
+        size_t size = s->window_size ? s->window_size * 2 : WINDOW_MIN;
+        char *w = realloc(s->window, size);
+        if (w == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        s->window = w;
+        s->window_size = size;
+    }
+
+    n = wkt_feed_read(wkt, s->window + len, s->window_size - len);
+    if (n < 0) {
+        return 1;
+    }
+
+    s->eof = (n == 0);
+    s->next = s->window;
+    s->end = s->window + len + n;
+
+    return 0;
+}
+
+/*
+ * Returns 1 if a record was found, 0 at end of input, MORE if the
+ * window needs refilling, -1 on error.
+ */
+static int w_record_text(struct stream *s, const char **rec, size_t *len)
+{
+    const char *p;
+    const char *e;
+
+    while (s->next < s->end) {
+        p = s->next;
+        e = memchr(p, '\n', s->end - p);
+        if (e == NULL) {
+            if (!s->eof) {
+                return MORE;
+            }
+            e = s->end;
+            s->next = s->end;
+        } else {
+            s->next = e + 1;
+        }
+
+        /* trim, skipping blank lines */
+        while (p < e && isspace((unsigned char)*p)) {
+            p++;
+        }
+        while (e > p && isspace((unsigned char)e[-1])) {
+            e--;
+        }
+
+        if (e > p) {
+            *rec = p;
+            *len = e - p;
+            return 1;
+        }
+    }
+
+    return s->eof ? 0 : MORE;
+}
+
+/* Read a WKT word; returns its length, 0 if there is none. */
+static size_t w_word(const char *p, const char *end, char *word)
+{
+    size_t len = 0;
+
+    while (p + len < end && isalpha((unsigned char)p[len])) {
+        if (len < MAX_WORD - 1) {
+            word[len] = toupper((unsigned char)p[len]);
+        }
+        len++;
+    }
+    word[(len < MAX_WORD) ? len : MAX_WORD - 1] = 0;
+
+    return len;
+}
+
+static const char *w_skip(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p)) {
+        p++;
+    }
+
+    return p;
+}
+
+static int w_magic(const char *p, const char *end, const char *magic)
+{
+    size_t len = strlen(magic);
+
+    return (size_t)(end - p) >= len && !memcmp(p, magic, len);
+}
+
+/* Work out whether the document is a collection worth splitting. */
+static int w_head(struct stream *s)
+{
+    static const struct {
+        const char *type;
+        const char *member;
+    } multi[] = {
+        { "GEOMETRYCOLLECTION", "" },
+        { "MULTIPOINT", "POINT" },
+        { "MULTILINESTRING", "LINESTRING" },
+        { "MULTIPOLYGON", "POLYGON" },
+    };
+    const char *p = w_skip(s->next, s->end);
+    const char *open = (p < s->end) ? memchr(p, '(', s->end - p) : NULL;
+    char type[MAX_WORD];
+    char dims[MAX_WORD];
+    size_t len;
+    size_t i;
+
+    if (w_magic(p, s->end, WKT_FGB_MAGIC) ||
+        w_magic(p, s->end, WKT_COLUMNAR_MAGIC)) {
+        fprintf(stderr, "Only WKT text can be split into members\n");
+        return -1;
+    }
+
+    if (open == NULL && !s->eof) {
+        return MORE;
+    }
+
+    s->state = SPLIT_WHOLE;
+
+    len = w_word(p, s->end, type);
+    p = w_skip(p + len, s->end);
+    len = w_word(p, s->end, dims);
+    if (strcmp(dims, "Z") && strcmp(dims, "M") && strcmp(dims, "ZM")) {
+        dims[0] = 0;
+        len = 0;
+    }
+    p = w_skip(p + len, s->end);
+
+    if (p != open) {
+        return 1; /* EMPTY, or not WKT at all */
+    }
+
+    for (i=0; i<sizeof(multi)/sizeof(multi[0]); i++) {
+        if (!strcmp(type, multi[i].type)) {
+            snprintf(s->prefix, sizeof(s->prefix), "%s%s%s",
+                     multi[i].member, dims[0] ? " " : "", dims);
+            s->state = SPLIT_BODY;
+            s->next = open + 1;
+            break;
+        }
+    }
+
+    return 1;
+}
+
+/* Like w_record_text(), but records are the document's members. */
+static int w_record_member(struct stream *s, const char **rec, size_t *len)
+{
+    const char *p;
+    const char *e;
+    int depth = 0;
+    int rc;
+
+    if (s->state == SPLIT_HEAD) {
+        rc = w_head(s);
+        if (rc != 1) {
+            return rc;
+        }
+    }
+
+    switch (s->state) {
+    case SPLIT_WHOLE:
+        if (!s->eof) {
+            return MORE;
+        }
+        p = s->next;
+        e = s->end;
+        s->next = s->end;
+        s->state = SPLIT_DONE;
+        break;
+    case SPLIT_BODY:
+        for (e = s->next; e < s->end; e++) {
+            if (*e == '(') {
+                depth++;
+            } else if (*e == ')' && depth-- == 0) {
+                s->state = SPLIT_DONE;
+                break;
+            } else if (*e == ',' && depth == 0) {
+                break;
+            }
+        }
+        if (e == s->end) {
+            if (!s->eof) {
+                return MORE;
+            }
+            fprintf(stderr, "Truncated WKT collection\n");
+            return -1;
+        }
+        p = s->next;
+        s->next = e + 1;
+        break;
+    default:
+        if (w_skip(s->next, s->end) != s->end) {
+            fprintf(stderr, "Unexpected text after WKT collection\n");
+            return -1;
+        }
+        s->next = s->end;
+        return 0;
+    }
+
+    p = w_skip(p, e);
+    while (e > p && isspace((unsigned char)e[-1])) {
+        e--;
+    }
+
+    if (e == p) {
+        /* only an empty document or "()" get here */
+        return (s->state == SPLIT_DONE) ? 0 : -1;
+    }
+
+    *rec = p;
+    *len = e - p;
+
+    return 1;
+}
+
+static int w_record_binary(struct stream *s, const char **rec, size_t *len)
+{
+    const unsigned char *p = (const unsigned char *)s->next;
+    size_t avail = s->end - s->next;
+    uint32_t n;
+
+    if (avail == 0) {
+        return s->eof ? 0 : MORE;
+    }
+
+    if (avail < sizeof(n)) {
+        if (!s->eof) {
+            return MORE;
+        }
+        fprintf(stderr, "Truncated record header\n");
+        return -1;
+    }
+
+    n = (uint32_t)p[0] |
+        ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) |
+        ((uint32_t)p[3] << 24);
+
+    if (avail - sizeof(n) < n) {
+        if (!s->eof) {
+            return MORE;
+        }
+        fprintf(stderr, "Truncated record\n");
+        return -1;
+    }
+
+    *rec = s->next + sizeof(n);
+    *len = n;
+    s->next = *rec + n;
+
+    return 1;
+}
+
+static GEOSGeometry *w_parse(
+    struct wkt *wkt,
+    struct stream *s,
+    const char *rec,
+    size_t len)
+{
+    GEOSGeometry *geom = NULL;
+    size_t plen = strlen(s->prefix);
+    int wrap;
+
+    switch (wkt->reader) {
+    case WKT_IO_ASCII:
+        /*
+         * The WKT reader wants a NUL terminated string. Members of a
+         * MULTI* type get their type put back, and bare MULTIPOINT
+         * coordinates their parentheses.
+         */
+        wrap = plen && rec[0] != '(' && !isalpha((unsigned char)rec[0]);
+        if (plen + len + 4 > s->line_size) {
+            char *line = realloc(s->line, plen + len + 4);
+            if (line == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                break;
+            }
+            s->line = line;
+            s->line_size = plen + len + 4;
+        }
+        snprintf(s->line, s->line_size, "%s%s%s%.*s%s",
+                 s->prefix, plen ? " " : "", wrap ? "(" : "",
+                 (int)len, rec, wrap ? ")" : "");
+        geom = GEOSWKTReader_read_r(wkt->handle, wkt->wktr, s->line);
+        break;
+    case WKT_IO_BINARY:
+        geom = GEOSWKBReader_read_r(
+            wkt->handle,
+            wkt->wkbr,
+            (const unsigned char *)rec,
+            len);
+        break;
+    case WKT_IO_HEX:
+        geom = GEOSWKBReader_readHEX_r(
+            wkt->handle,
+            wkt->wkbr,
+            (const unsigned char *)rec,
+            len);
+        break;
+    default:
+        break;
+    }
+
+    return geom;
+}
+
+static int w_stream(
+    struct wkt *wkt,
+    const char *file,
+    int split,
+    wkt_iterator_t iterator,
+    void *user_data)
+{
+    int err = 1;
+    int rc;
+    const char *rec = NULL;
+    size_t len = 0;
+    struct stream s;
+    GEOSGeometry *geom;
+    GEOSGeometry *save = wkt->geom;
+    size_t step = RELEASE_STEP;
+    uint64_t start;
+
+    memset(&s, 0, sizeof(s));
+    s.split = split;
+    s.state = SPLIT_HEAD;
+
+    if (wkt->budget && wkt->budget / 4 < step) {
+        /* mapped pages count against the budget too */
+        step = wkt->budget / 4;
+    }
+
+    do {
+        err = wkt_source(wkt, file);
+        if (err) {
+            break;
+        }
+
+        if (wkt->feed == NULL) {
+            s.next = wkt->input;
+            s.end = wkt->input + wkt->input_len;
+            s.eof = 1;
+        }
+
+        for (;;) {
+            if (s.split) {
+                rc = w_record_member(&s, &rec, &len);
+            } else if (wkt->reader == WKT_IO_BINARY) {
+                rc = w_record_binary(&s, &rec, &len);
+            } else {
+                rc = w_record_text(&s, &rec, &len);
+            }
+
+            if (rc == MORE) {
+                err = w_fill(wkt, &s);
+                if (err) {
+                    break;
+                }
+                continue;
+            }
+
+            if (rc <= 0) {
+                err = (rc < 0);
+                break;
+            }
+
+            start = wkt_stats_begin(WKT_PHASE_READ);
+            geom = w_parse(wkt, &s, rec, len);
+            wkt_stats_add(WKT_PHASE_READ, start);
+            if (geom == NULL) {
+                err = 1;
+                break;
+            }
+            wkt_stats_parsed(wkt, geom);
+
+            /* Present the record's members as wkt_iterate() would. */
+            err = 0;
+            if (!GEOSisEmpty_r(wkt->handle, geom)) {
+                wkt->geom = geom;
+                err = wkt_iterate(wkt, iterator, user_data);
+                wkt->geom = save;
+                wkt_forget_bounds(wkt);
+            }
+
+            GEOSGeom_destroy_r(wkt->handle, geom);
+
+            if (err) {
+                break;
+            }
+
+            if (wkt->map &&
+                (size_t)(s.next - wkt->input) >=
+                wkt->map_released + step) {
+                wkt_release(wkt, s.next - wkt->input);
+            }
+        }
+
+    } while (0);
+
+    wkt_unmap(wkt);
+    free(s.window);
+    free(s.line);
+
+    return err;
+}
+
+int wkt_stream(
+    struct wkt *wkt,
+    const char *file,
+    wkt_iterator_t iterator,
+    void *user_data)
+{
+    return w_stream(wkt, file, 0, iterator, user_data);
+}
+
+int wkt_stream_split(
+    struct wkt *wkt,
+    const char *file,
+    wkt_iterator_t iterator,
+    void *user_data)
+{
+    if (wkt->reader != WKT_IO_ASCII) {
+        fprintf(stderr, "Only WKT text can be split into members\n");
+        return 1;
+    }
+
+    return w_stream(wkt, file, 1, iterator, user_data);
+}
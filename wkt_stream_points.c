@@ -0,0 +1,86 @@
+/*
+   wkt_stream_points.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wkt.h"
+
+/*
+ * Stream record input keeping only the vertices of each member. This
+ * is all that triangulation, tessellation and hull operations look
+ * at, so wkt->geom ends up as a collection of points (or multipoints)
+ * instead of the full input geometry.
+ */
+
+struct points {
+    GEOSGeometry **geom;
+    unsigned int n;
+    unsigned int size;
+};
+
+static int w_gather(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    const char *gtype,
+    void *user_data)
+{
+    struct points *points = user_data;
+    GEOSGeometry *g;
+
+    (void)gtype;
+    if (points->n == points->size) {
+        unsigned int size = points->size ? points->size * 2 : 1024;
+        GEOSGeometry **p = realloc(points->geom, size * sizeof(*p));
+        if (p == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        points->geom = p;
+        points->size = size;
+    }
+
+    if (GEOSGeomTypeId_r(wkt->handle, geom) == GEOS_POINT) {
+        g = GEOSGeom_clone_r(wkt->handle, geom);
+    } else {
+        g = GEOSGeom_extractUniquePoints_r(wkt->handle, geom);
+    }
+
+    if (g == NULL) {
+        return 1;
+    }
+
+    points->geom[points->n++] = g;
+
+    return 0;
+}
+
+int wkt_stream_points(struct wkt *wkt, const char *file)
+{
+    int err = 1;
+    unsigned int i;
+    struct points points = { NULL, 0, 0 };
+
+    err = wkt_stream(wkt, file, w_gather, &points);
+
+    if (!err) {
+        /* the collection takes ownership of the members */
+        wkt->geom = GEOSGeom_createCollection_r(
+            wkt->handle,
+            GEOS_GEOMETRYCOLLECTION,
+            points.geom,
+            points.n);
+        err = (wkt->geom == NULL);
+    } else {
+        for (i=0; i<points.n; i++) {
+            GEOSGeom_destroy_r(wkt->handle, points.geom[i]);
+        }
+    }
+
+    free(points.geom);
+
+    return err;
+}
@@ -0,0 +1,53 @@
+/*
+   wkt_traverse.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+
+/*
+ * Visit every simple geometry in geom, depth first and in order.
+ * MULTI* types and geometry collections, nested or not, are descended
+ * into; everything else is handed to visitor with its GEOS type id.
+ * Nothing is allocated on the way.
+ */
+int wkt_traverse(
+    struct wkt *wkt,
+    const GEOSGeometry *geom,
+    wkt_visitor_t visitor,
+    void *user_data)
+{
+    int err = 0;
+    int type;
+    int n;
+    int i;
+    const GEOSGeometry *g;
+
+    type = GEOSGeomTypeId_r(wkt->handle, geom);
+    switch (type) {
+    case -1:
+        err = 1;
+        break;
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        n = GEOSGetNumGeometries_r(wkt->handle, geom);
+        for (i=0; !err && i<n; i++) {
+            g = GEOSGetGeometryN_r(wkt->handle, geom, i);
+            if (g == NULL) {
+                err = 1;
+                break;
+            }
+            err = wkt_traverse(wkt, g, visitor, user_data);
+        }
+        break;
+    default:
+        err = visitor(wkt, geom, type, user_data);
+        break;
+    }
+
+    return err;
+}
@@ -0,0 +1,36 @@
+/*
+   wkt_type_name.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+
+/*
+ * The name GEOSGeomType_r() gives a GEOS type id, without allocating
+ * a copy each time. NULL for types not listed here.
+ */
+const char *wkt_type_name(int type)
+{
+    switch (type) {
+    case GEOS_POINT:
+        return "Point";
+    case GEOS_LINESTRING:
+        return "LineString";
+    case GEOS_LINEARRING:
+        return "LinearRing";
+    case GEOS_POLYGON:
+        return "Polygon";
+    case GEOS_MULTIPOINT:
+        return "MultiPoint";
+    case GEOS_MULTILINESTRING:
+        return "MultiLineString";
+    case GEOS_MULTIPOLYGON:
+        return "MultiPolygon";
+    case GEOS_GEOMETRYCOLLECTION:
+        return "GeometryCollection";
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,34 @@
+/*
+   wkt_unmap.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include "wkt.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Give back the input, however it was attached. */
+void wkt_unmap(struct wkt *wkt)
+{
+    if (wkt->map) {
+        munmap(wkt->map, wkt->map_len);
+        wkt_stats_mapped(-(int64_t)wkt->map_len);
+        if (wkt->map_fd != STDIN_FILENO) {
+            close(wkt->map_fd);
+        }
+        wkt->map = NULL;
+        wkt->map_len = 0;
+        wkt->map_released = 0;
+    }
+
+    wkt_feed_close(wkt);
+
+    free(wkt->buffer);
+    wkt->buffer = NULL;
+
+    wkt->input = NULL;
+    wkt->input_len = 0;
+}
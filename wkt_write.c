@@ -5,10 +5,268 @@
 
 */
 
+#include <stdio.h>
 #include <string.h>
 #include "wkt.h"
 
-int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
+/*
+ * WKT is written by wkt_write_text(), in any dimension. Types it does
+ * not know, such as curves, and everything binary go through the GEOS
+ * writers.
+ *
+ * With wkt->threads > 1 collection members after the first are
+ * serialized on a worker pool by wkt_write_parallel(); the bytes are
+ * the same either way.
+ *
+ * Collections are written a member at a time through a wkt_sink, so
+ * the serialized form of the whole collection never exists at once.
+ * For WKB, GEOS serializes each member on its own and the collection
+ * header, taking the byte order and type flags of the first member,
+ * is put in front. That is only what GEOS would write when every
+ * member has the dimensions of the collection; GEOS writes a mixed
+ * collection whole.
+ */
+
+#define WKB_HEADER 9 /* byte order, type, count */
+#define WKB_SRID 0x20000000
+#define WKB_ZM 0xC0000000
+#define WKB_ISO 1000
+
+static const char *w_name(int type)
+{
+    switch (type) {
+    case GEOS_MULTIPOINT:
+        return "MULTIPOINT";
+    case GEOS_MULTILINESTRING:
+        return "MULTILINESTRING";
+    case GEOS_MULTIPOLYGON:
+        return "MULTIPOLYGON";
+    case GEOS_GEOMETRYCOLLECTION:
+        return "GEOMETRYCOLLECTION";
+    default:
+        return NULL;
+    }
+}
+
+static void w_put32(unsigned char *p, uint32_t v, int little)
+{
+    int i;
+
+    for (i=0; i<4; i++) {
+        p[little ? i : 3 - i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint32_t w_get32(const unsigned char *p, int little)
+{
+    uint32_t v = 0;
+    int i;
+
+    for (i=0; i<4; i++) {
+        v |= (uint32_t)p[little ? i : 3 - i] << (8 * i);
+    }
+
+    return v;
+}
+
+static int w_unhex(const char *s, unsigned char *p, size_t n)
+{
+    unsigned int v;
+    size_t i;
+
+    for (i=0; i<n; i++) {
+        if (sscanf(s + 2 * i, "%2x", &v) != 1) {
+            return 1;
+        }
+        p[i] = v;
+    }
+
+    return 0;
+}
+
+/* Collection header from the first member's byte order and flags. */
+static int w_header(
+    int type,
+    int n,
+    const unsigned char *member,
+    unsigned char *header)
+{
+    int little = (member[0] == 1);
+    uint32_t mtype = w_get32(member + 1, little);
+    uint32_t ctype = type; /* GEOS multi type ids are the WKB codes */
+
+    if (mtype & WKB_SRID) {
+        fprintf(stderr, "Cannot stream WKB members with SRID\n");
+        return 1;
+    }
+
+    if (mtype & WKB_ZM) {
+        ctype |= mtype & WKB_ZM;
+    } else {
+        ctype += (mtype / WKB_ISO) * WKB_ISO;
+    }
+
+    header[0] = member[0];
+    w_put32(header + 1, ctype, little);
+    w_put32(header + 5, n, little);
+
+    return 0;
+}
+
+/* Member i as WKB or hex WKB, led by the collection header if first. */
+static int w_binary(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int i)
+{
+    int err = 0;
+    int hex = (wkt->writer == WKT_IO_HEX);
+    int type = GEOSGeomTypeId_r(wkt->handle, geom);
+    int n = GEOSGetNumGeometries_r(wkt->handle, geom);
+    const GEOSGeometry *g;
+    unsigned char *data;
+    unsigned char member[WKB_HEADER];
+    unsigned char header[WKB_HEADER];
+    char text[2 * WKB_HEADER + 1];
+    size_t len;
+    size_t j;
+
+    g = GEOSGetGeometryN_r(wkt->handle, geom, i);
+    if (hex) {
+        data = GEOSWKBWriter_writeHEX_r(wkt->handle, wkt->wkbw, g, &len);
+    } else {
+        data = GEOSWKBWriter_write_r(wkt->handle, wkt->wkbw, g, &len);
+    }
+    if (data == NULL) {
+        return 1;
+    }
+
+    if (i == 0) {
+        if (hex) {
+            err = (len < 2 * WKB_HEADER) ||
+                w_unhex((const char *)data, member, sizeof(member));
+        } else {
+            err = (len < WKB_HEADER);
+            if (!err) {
+                memcpy(member, data, sizeof(member));
+            }
+        }
+        if (!err) {
+            err = w_header(type, n, member, header);
+        }
+        if (!err && hex) {
+            for (j=0; j<sizeof(header); j++) {
+                snprintf(text + 2 * j, 3, "%02X", header[j]);
+            }
+            wkt_sink_write(sink, text, 2 * sizeof(header));
+        } else if (!err) {
+            wkt_sink_write(sink, header, sizeof(header));
+        }
+    }
+
+    if (!err) {
+        err = wkt_sink_write(sink, data, len);
+    }
+
+    GEOSFree_r(wkt->handle, data);
+
+    return err;
+}
+
+/* Non-empty collections without an SRID are written member by member. */
+static int w_members(struct wkt *wkt, const GEOSGeometry *geom)
+{
+    return w_name(GEOSGeomTypeId_r(wkt->handle, geom)) != NULL &&
+        GEOSGetNumGeometries_r(wkt->handle, geom) > 0 &&
+        GEOSGetSRID_r(wkt->handle, geom) == 0;
+}
+
+static int w_write_text(
+    struct wkt *wkt,
+    const char *file,
+    const GEOSGeometry *geom)
+{
+    int err;
+    struct wkt_sink sink;
+
+    err = wkt_sink_open(&sink, file);
+    if (!err) {
+        err = wkt_write_text(wkt, &sink, geom);
+    }
+    if (wkt_sink_close(&sink)) {
+        err = 1;
+    }
+
+    return err;
+}
+
+/* Every member has the Z and M of the collection. */
+static int w_uniform(struct wkt *wkt, const GEOSGeometry *geom)
+{
+    GEOSContextHandle_t h = wkt->handle;
+    int has_z = GEOSHasZ_r(h, geom);
+    int has_m = GEOSHasM_r(h, geom);
+    int n = GEOSGetNumGeometries_r(h, geom);
+    const GEOSGeometry *g;
+    int i;
+
+    for (i=0; i<n; i++) {
+        g = GEOSGetGeometryN_r(h, geom, i);
+        if (GEOSHasZ_r(h, g) != has_z || GEOSHasM_r(h, g) != has_m) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* The native writer knows the linear types. */
+static int w_native(struct wkt *wkt, const GEOSGeometry *geom)
+{
+    return wkt_type_name(GEOSGeomTypeId_r(wkt->handle, geom)) != NULL;
+}
+
+static int w_write_members(
+    struct wkt *wkt,
+    const char *file,
+    const GEOSGeometry *geom)
+{
+    int err;
+    struct wkt_sink sink;
+    int n = GEOSGetNumGeometries_r(wkt->handle, geom);
+    wkt_member_t member;
+    int i;
+
+    if (wkt->writer == WKT_IO_ASCII) {
+        member = wkt_write_text_member;
+    } else {
+        member = w_binary;
+    }
+
+    err = wkt_sink_open(&sink, file);
+    if (!err) {
+        /* the first member also settles the header */
+        err = member(wkt, &sink, geom, 0);
+    }
+    if (!err && wkt->threads > 1 && n > 1) {
+        err = wkt_write_parallel(wkt, &sink, geom, 1, member);
+    } else {
+        for (i=1; !err && i<n; i++) {
+            err = member(wkt, &sink, geom, i);
+        }
+    }
+    if (!err && wkt->writer == WKT_IO_ASCII) {
+        err = wkt_sink_write(&sink, ")", 1);
+    }
+    if (wkt_sink_close(&sink)) {
+        err = 1;
+    }
+
+    return err;
+}
+
+static int w_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
 {
     int err = 1;
     const char *data;
@@ -16,6 +274,12 @@ int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
 
     switch (wkt->writer) {
     case WKT_IO_ASCII:
+        if (w_native(wkt, geom)) {
+            if (wkt->threads > 1 && w_members(wkt, geom)) {
+                return w_write_members(wkt, file, geom);
+            }
+            return w_write_text(wkt, file, geom);
+        }
         data = GEOSWKTWriter_write_r(wkt->handle, wkt->wktw, geom);
         if (data) {
             len = strlen(data);
@@ -23,6 +287,9 @@ int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
         }
         break;
     case WKT_IO_BINARY:
+        if (w_members(wkt, geom) && w_uniform(wkt, geom)) {
+            return w_write_members(wkt, file, geom);
+        }
         data = (char *)GEOSWKBWriter_write_r(
             wkt->handle,
             wkt->wkbw,
@@ -31,6 +298,9 @@ int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
         err = (data == NULL);
         break;
     case WKT_IO_HEX:
+        if (w_members(wkt, geom) && w_uniform(wkt, geom)) {
+            return w_write_members(wkt, file, geom);
+        }
         data = (char *)GEOSWKBWriter_writeHEX_r(
             wkt->handle,
             wkt->wkbw,
@@ -38,6 +308,11 @@ int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
             &len);
         err = (data == NULL);
         break;
+    case WKT_IO_COLUMNAR:
+        /* written directly, nothing to stash */
+        return wkt_write_columnar(wkt, file, geom);
+    case WKT_IO_FGB:
+        return wkt_write_fgb(wkt, file, geom);
     default:
         err = 1;
         break;
@@ -50,3 +325,14 @@ int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
 
     return err;
 }
+
+int wkt_write(struct wkt *wkt, const char *file, const GEOSGeometry *geom)
+{
+    int err;
+    uint64_t start = wkt_stats_begin(WKT_PHASE_WRITE);
+
+    err = w_write(wkt, file, geom);
+    wkt_stats_phase(WKT_PHASE_WRITE, start);
+
+    return err;
+}
@@ -0,0 +1,226 @@
+/*
+   wkt_write_columnar.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wkt.h"
+
+/*
+ * Write geometry as a columnar file (see struct wkt_columnar): the
+ * geometry tree is flattened in preorder into node type and count
+ * columns, and every coordinate sequence is appended to packed x and
+ * y columns, and z and m columns if the geometry has them. Members
+ * without a Z or M that the whole geometry has get NaN there.
+ */
+
+#define ALIGN(n) (((n) + 7) & ~((uint64_t)7))
+
+struct columns {
+    size_t nodes;
+    size_t coords;
+    int32_t *node_type;
+    uint32_t *node_count;
+    double *x;
+    double *y;
+    double *z;
+    double *m;
+};
+
+/* Add one node, and its coordinates if it has a sequence. */
+static int w_node(
+    struct wkt *wkt,
+    struct columns *col,
+    int type,
+    unsigned int count,
+    const GEOSGeometry *geom)
+{
+    const GEOSCoordSequence *seq;
+    int rc;
+
+    if (col->node_type) {
+        col->node_type[col->nodes] = type;
+        col->node_count[col->nodes] = count;
+    }
+    col->nodes++;
+
+    if (geom == NULL || count == 0) {
+        return 0;
+    }
+
+    if (col->x) {
+        seq = GEOSGeom_getCoordSeq_r(wkt->handle, geom);
+        if (seq == NULL) {
+            return 1;
+        }
+        rc = GEOSCoordSeq_copyToArrays_r(
+            wkt->handle,
+            seq,
+            col->x + col->coords,
+            col->y + col->coords,
+            col->z ? col->z + col->coords : NULL,
+            col->m ? col->m + col->coords : NULL);
+        if (!rc) {
+            return 1;
+        }
+    }
+    col->coords += count;
+
+    return 0;
+}
+
+/* Flatten geom; without arrays this only counts. */
+static int w_flatten(
+    struct wkt *wkt,
+    struct columns *col,
+    const GEOSGeometry *geom)
+{
+    int err = 1;
+    int type;
+    int n;
+    int i;
+
+    type = GEOSGeomTypeId_r(wkt->handle, geom);
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        n = GEOSGetNumCoordinates_r(wkt->handle, geom);
+        if (n < 0) {
+            break;
+        }
+        err = w_node(wkt, col, type, n, geom);
+        break;
+    case GEOS_POLYGON:
+        if (GEOSisEmpty_r(wkt->handle, geom)) {
+            err = w_node(wkt, col, type, 0, NULL);
+            break;
+        }
+        n = GEOSGetNumInteriorRings_r(wkt->handle, geom);
+        if (n < 0) {
+            break;
+        }
+        err = w_node(wkt, col, type, n + 1, NULL);
+        if (!err) {
+            err = w_flatten(
+                wkt,
+                col,
+                GEOSGetExteriorRing_r(wkt->handle, geom));
+        }
+        for (i=0; !err && i<n; i++) {
+            err = w_flatten(
+                wkt,
+                col,
+                GEOSGetInteriorRingN_r(wkt->handle, geom, i));
+        }
+        break;
+    case GEOS_MULTIPOINT:
+    case GEOS_MULTILINESTRING:
+    case GEOS_MULTIPOLYGON:
+    case GEOS_GEOMETRYCOLLECTION:
+        n = GEOSGetNumGeometries_r(wkt->handle, geom);
+        if (n < 0) {
+            break;
+        }
+        err = w_node(wkt, col, type, n, NULL);
+        for (i=0; !err && i<n; i++) {
+            err = w_flatten(
+                wkt,
+                col,
+                GEOSGetGeometryN_r(wkt->handle, geom, i));
+        }
+        break;
+    default:
+        fprintf(stderr, "Unsupported geometry type %d\n", type);
+        break;
+    }
+
+    return err;
+}
+
+int wkt_write_columnar(
+    struct wkt *wkt,
+    const char *file,
+    const GEOSGeometry *geom)
+{
+    int err = 1;
+    struct columns col;
+    struct wkt_columnar hdr;
+    char *data = NULL;
+    uint64_t len;
+    int has_z;
+    int has_m;
+
+    memset(&col, 0, sizeof(col));
+    memset(&hdr, 0, sizeof(hdr));
+
+    do {
+        /* sizing pass */
+        err = w_flatten(wkt, &col, geom);
+        if (err) {
+            break;
+        }
+
+        has_z = (GEOSHasZ_r(wkt->handle, geom) == 1);
+        has_m = (GEOSHasM_r(wkt->handle, geom) == 1);
+
+        memcpy(hdr.magic, WKT_COLUMNAR_MAGIC, sizeof(hdr.magic));
+        hdr.version = WKT_COLUMNAR_VERSION;
+        hdr.dims = 2 + has_z + has_m;
+        hdr.flags =
+            (has_z ? WKT_COLUMNAR_Z : 0) | (has_m ? WKT_COLUMNAR_M : 0);
+        hdr.type = GEOSGeomTypeId_r(wkt->handle, geom);
+        hdr.nodes = col.nodes;
+        hdr.coords = col.coords;
+        hdr.type_offset = ALIGN(sizeof(hdr));
+        hdr.count_offset =
+            ALIGN(hdr.type_offset + hdr.nodes * sizeof(*col.node_type));
+        hdr.x_offset =
+            ALIGN(hdr.count_offset + hdr.nodes * sizeof(*col.node_count));
+        hdr.y_offset = hdr.x_offset + hdr.coords * sizeof(*col.x);
+        len = hdr.y_offset + hdr.coords * sizeof(*col.y);
+        if (has_z) {
+            hdr.z_offset = len;
+            len += hdr.coords * sizeof(*col.z);
+        }
+        if (has_m) {
+            hdr.m_offset = len;
+            len += hdr.coords * sizeof(*col.m);
+        }
+
+        err = 1;
+        data = calloc(1, len);
+        if (data == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+
+        memcpy(data, &hdr, sizeof(hdr));
+        col.node_type = (int32_t *)(data + hdr.type_offset);
+        col.node_count = (uint32_t *)(data + hdr.count_offset);
+        col.x = (double *)(data + hdr.x_offset);
+        col.y = (double *)(data + hdr.y_offset);
+        col.z = has_z ? (double *)(data + hdr.z_offset) : NULL;
+        col.m = has_m ? (double *)(data + hdr.m_offset) : NULL;
+        col.nodes = 0;
+        col.coords = 0;
+
+        /* fill pass */
+        err = w_flatten(wkt, &col, geom);
+        if (err) {
+            break;
+        }
+
+        err = wkt_stash(file, data, len);
+
+    } while (0);
+
+    free(data);
+
+    return err;
+}
@@ -0,0 +1,269 @@
+/*
+   wkt_write_parallel.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "wkt.h"
+
+/*
+ * Serialize collection members on several threads. Members are cut
+ * into chunks that workers format into memory sinks, each worker with
+ * its own GEOS context and writers set up like the caller's. The
+ * calling thread writes finished chunks out in order with writev().
+ * Workers only run a few chunks ahead of the writer, so memory stays
+ * bounded by the window, not by the size of the output.
+ */
+
+#define CHUNKS_PER_THREAD 8
+#define CHUNK_MAX 4096 /* members */
+#define WINDOW_PER_THREAD 2 /* chunks formatted ahead of the writer */
+
+typedef enum {
+    CHUNK_PENDING,
+    CHUNK_DONE,
+} chunk_state_t;
+
+struct chunk {
+    struct wkt_sink out;
+    chunk_state_t state;
+};
+
+struct job {
+    struct wkt *wkt;
+    const GEOSGeometry *geom;
+    wkt_member_t member;
+    int first;
+    int n;
+    int per_chunk;
+    size_t chunks;
+    struct chunk *chunk;
+    size_t next; /* next chunk to hand out */
+    size_t written; /* chunks written so far */
+    size_t window;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static int w_format(struct job *job, struct wkt *wkt, size_t c)
+{
+    int err;
+    struct chunk *chunk = &job->chunk[c];
+    int i = job->first + c * job->per_chunk;
+    int end = i + job->per_chunk;
+    uint64_t start = wkt_stats_now();
+
+    if (end > job->n) {
+        end = job->n;
+    }
+
+    err = wkt_sink_memory(&chunk->out);
+    for (; !err && i<end; i++) {
+        err = job->member(wkt, &chunk->out, job->geom, i);
+    }
+
+    wkt_stats_trace("format chunk", start);
+
+    return err;
+}
+
+static void *w_worker(void *arg)
+{
+    struct job *job = arg;
+    struct wkt wkt;
+    size_t c;
+    int err;
+
+    /* a context and writers of our own, set up the same way */
+    memset(&wkt, 0, sizeof(wkt));
+    wkt.writer = job->wkt->writer;
+    wkt.precision = job->wkt->precision;
+    err = wkt_open(&wkt);
+
+    pthread_mutex_lock(&job->lock);
+    if (err) {
+        job->failed = 1;
+        pthread_cond_broadcast(&job->cond);
+    }
+    for (;;) {
+        while (!job->failed && job->next < job->chunks &&
+               job->next >= job->written + job->window) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+        if (job->failed || job->next >= job->chunks) {
+            break;
+        }
+        c = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        err = w_format(job, &wkt, c);
+
+        pthread_mutex_lock(&job->lock);
+        job->chunk[c].state = CHUNK_DONE;
+        if (err) {
+            job->failed = 1;
+        }
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    if (wkt.handle) {
+        wkt_close(&wkt);
+    }
+
+    return NULL;
+}
+
+/* Write out finished chunks in order until all are written. */
+static int w_drain(struct job *job, struct wkt_sink *sink)
+{
+    int err = 0;
+    struct iovec *iov;
+    size_t from;
+    size_t k;
+    size_t i;
+
+    iov = malloc(job->window * sizeof(*iov));
+    if (iov == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    while (!err && job->written < job->chunks) {
+        while (!job->failed && job->chunk[job->written].state != CHUNK_DONE) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+        if (job->failed) {
+            err = 1;
+            break;
+        }
+
+        /* everything finished in a row goes out in one call */
+        from = job->written;
+        for (k=0; k<job->window && from + k < job->chunks; k++) {
+            struct chunk *chunk = &job->chunk[from + k];
+            if (chunk->state != CHUNK_DONE) {
+                break;
+            }
+            iov[k].iov_base = chunk->out.buf;
+            iov[k].iov_len = chunk->out.len;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        err = wkt_sink_writev(sink, iov, k);
+        for (i=0; i<k; i++) {
+            wkt_sink_close(&job->chunk[from + i].out);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->written += k;
+        if (err) {
+            job->failed = 1;
+        }
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    free(iov);
+
+    return err;
+}
+
+/*
+ * Write members first .. n-1 of the collection geom into sink with
+ * member, on wkt->threads workers. The output is the same as calling
+ * member for each in turn.
+ */
+int wkt_write_parallel(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int first,
+    wkt_member_t member)
+{
+    int err = 1;
+    unsigned int i;
+    unsigned int threads = wkt->threads;
+    unsigned int started = 0;
+    pthread_t *tid = NULL;
+    struct job job;
+    size_t c;
+
+    memset(&job, 0, sizeof(job));
+    job.wkt = wkt;
+    job.geom = geom;
+    job.member = member;
+    job.first = first;
+    job.n = GEOSGetNumGeometries_r(wkt->handle, geom);
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    do {
+        if (job.n <= first) {
+            err = 0;
+            break;
+        }
+        if (threads > (unsigned int)(job.n - first)) {
+            threads = job.n - first;
+        }
+
+        job.per_chunk = (job.n - first) / (threads * CHUNKS_PER_THREAD);
+        if (job.per_chunk == 0) {
+            job.per_chunk = 1;
+        } else if (job.per_chunk > CHUNK_MAX) {
+            job.per_chunk = CHUNK_MAX;
+        }
+        job.chunks = (job.n - first + job.per_chunk - 1) / job.per_chunk;
+        job.window = threads * WINDOW_PER_THREAD;
+
+        job.chunk = calloc(job.chunks, sizeof(*job.chunk));
+        tid = calloc(threads, sizeof(*tid));
+        if (job.chunk == NULL || tid == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+
+        for (i=0; i<threads; i++) {
+            if (pthread_create(&tid[i], NULL, w_worker, &job)) {
+                fprintf(stderr, "Could not create thread\n");
+                break;
+            }
+            started++;
+        }
+
+        if (started == threads) {
+            err = w_drain(&job, sink);
+        }
+        if (err) {
+            /* stop the workers */
+            pthread_mutex_lock(&job.lock);
+            job.failed = 1;
+            pthread_cond_broadcast(&job.cond);
+            pthread_mutex_unlock(&job.lock);
+        }
+
+        for (i=0; i<started; i++) {
+            pthread_join(tid[i], NULL);
+        }
+
+    } while (0);
+
+    /* chunks formatted but never written */
+    for (c=0; c<job.chunks && job.chunk; c++) {
+        wkt_sink_close(&job.chunk[c].out);
+    }
+
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.lock);
+    free(tid);
+    free(job.chunk);
+
+    return err;
+}
@@ -0,0 +1,288 @@
+/*
+   wkt_write_text.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wkt.h"
+
+/*
+ * Native WKT writer, laid out as GEOS writes it but with numbers from
+ * wkt_dtoa(): shortest round trip by default, or rounded to
+ * wkt->precision.places. Output goes straight into the sink, a
+ * coordinate at a time. Z and M are written as GEOS does, with the
+ * dimension word after the type of every tagged geometry.
+ */
+
+struct text {
+    struct wkt *wkt;
+    struct wkt_sink *sink;
+    int places;
+    double *xy; /* coordinate scratch */
+    size_t size;
+};
+
+static const char *w_name(int type)
+{
+    switch (type) {
+    case GEOS_POINT:
+        return "POINT";
+    case GEOS_LINESTRING:
+        return "LINESTRING";
+    case GEOS_LINEARRING:
+        return "LINEARRING";
+    case GEOS_POLYGON:
+        return "POLYGON";
+    case GEOS_MULTIPOINT:
+        return "MULTIPOINT";
+    case GEOS_MULTILINESTRING:
+        return "MULTILINESTRING";
+    case GEOS_MULTIPOLYGON:
+        return "MULTIPOLYGON";
+    case GEOS_GEOMETRYCOLLECTION:
+        return "GEOMETRYCOLLECTION";
+    default:
+        return NULL;
+    }
+}
+
+static int w_put(struct text *t, const char *s)
+{
+    return wkt_sink_write(t->sink, s, strlen(s));
+}
+
+/*
+ * Coordinates with dims values each, every one led by "(" or ", ".
+ * There is a copy for each of 2, 3 and 4 dimensions so that XY does
+ * not pay for the wider layouts.
+ */
+#define W_COORDS(name, dims)                                            \
+    static int name(struct text *t, const double *c, unsigned int n)    \
+    {                                                                   \
+        int err = 0;                                                    \
+        char line[(dims) * (WKT_DTOA_SIZE + 1) + 2];                    \
+        size_t len;                                                     \
+        unsigned int i;                                                 \
+        int d;                                                          \
+                                                                        \
+        for (i=0; !err && i<n; i++, c += (dims)) {                      \
+            len = 0;                                                    \
+            if (i == 0) {                                               \
+                line[len++] = '(';                                      \
+            } else {                                                    \
+                line[len++] = ',';                                      \
+                line[len++] = ' ';                                      \
+            }                                                           \
+            len += wkt_dtoa(c[0], t->places, line + len);               \
+            for (d=1; d<(dims); d++) {                                  \
+                line[len++] = ' ';                                      \
+                len += wkt_dtoa(c[d], t->places, line + len);           \
+            }                                                           \
+            err = wkt_sink_write(t->sink, line, len);                   \
+        }                                                               \
+                                                                        \
+        return err;                                                     \
+    }
+
+W_COORDS(w_coords2, 2)
+W_COORDS(w_coords3, 3)
+W_COORDS(w_coords4, 4)
+
+/* The dimension word of a tagged geometry, with its leading space. */
+static const char *w_dims(int has_z, int has_m)
+{
+    if (has_z && has_m) {
+        return " ZM";
+    } else if (has_z) {
+        return " Z";
+    } else if (has_m) {
+        return " M";
+    } else {
+        return "";
+    }
+}
+
+static int w_seq(
+    struct text *t,
+    const GEOSCoordSequence *seq,
+    int has_z,
+    int has_m)
+{
+    int err;
+    unsigned int n;
+    unsigned int dims = 2 + has_z + has_m;
+
+    if (seq == NULL || !GEOSCoordSeq_getSize_r(t->wkt->handle, seq, &n)) {
+        return 1;
+    }
+    if (n == 0) {
+        return w_put(t, "EMPTY");
+    }
+
+    if (dims * (size_t)n > t->size) {
+        double *xy = realloc(t->xy, dims * (size_t)n * sizeof(*xy));
+        if (xy == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        t->xy = xy;
+        t->size = dims * (size_t)n;
+    }
+
+    if (!GEOSCoordSeq_copyToBuffer_r(
+            t->wkt->handle, seq, t->xy, has_z, has_m)) {
+        return 1;
+    }
+
+    switch (dims) {
+    case 2:
+        err = w_coords2(t, t->xy, n);
+        break;
+    case 3:
+        err = w_coords3(t, t->xy, n);
+        break;
+    default:
+        err = w_coords4(t, t->xy, n);
+        break;
+    }
+
+    if (!err) {
+        err = w_put(t, ")");
+    }
+
+    return err;
+}
+
+static int w_geom(struct text *t, const GEOSGeometry *geom, int tagged)
+{
+    int err = 0;
+    GEOSContextHandle_t handle = t->wkt->handle;
+    int type = GEOSGeomTypeId_r(handle, geom);
+    const char *name = w_name(type);
+    int has_z = (GEOSHasZ_r(handle, geom) == 1);
+    int has_m = (GEOSHasM_r(handle, geom) == 1);
+    int n;
+    int i;
+
+    if (name == NULL) {
+        fprintf(stderr, "Cannot write geometry type %d\n", type);
+        return 1;
+    }
+
+    if (tagged) {
+        w_put(t, name);
+        w_put(t, w_dims(has_z, has_m));
+        w_put(t, " ");
+    }
+
+    if (GEOSisEmpty_r(handle, geom)) {
+        return w_put(t, "EMPTY");
+    }
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        err = w_seq(t, GEOSGeom_getCoordSeq_r(handle, geom), has_z, has_m);
+        break;
+    case GEOS_POLYGON:
+        n = GEOSGetNumInteriorRings_r(handle, geom);
+        w_put(t, "(");
+        err = w_seq(t, GEOSGeom_getCoordSeq_r(
+                        handle, GEOSGetExteriorRing_r(handle, geom)),
+                    has_z, has_m);
+        for (i=0; !err && i<n; i++) {
+            w_put(t, ", ");
+            err = w_seq(t, GEOSGeom_getCoordSeq_r(
+                            handle, GEOSGetInteriorRingN_r(handle, geom, i)),
+                        has_z, has_m);
+        }
+        if (!err) {
+            err = w_put(t, ")");
+        }
+        break;
+    default:
+        /* only collection members keep their type word */
+        n = GEOSGetNumGeometries_r(handle, geom);
+        w_put(t, "(");
+        for (i=0; !err && i<n; i++) {
+            if (i) {
+                w_put(t, ", ");
+            }
+            err = w_geom(t, GEOSGetGeometryN_r(handle, geom, i),
+                         type == GEOS_GEOMETRYCOLLECTION);
+        }
+        if (!err) {
+            err = w_put(t, ")");
+        }
+        break;
+    }
+
+    return err;
+}
+
+static void w_init(struct text *t, struct wkt *wkt, struct wkt_sink *sink)
+{
+    memset(t, 0, sizeof(*t));
+    t->wkt = wkt;
+    t->sink = sink;
+    t->places = wkt->precision.valid ? wkt->precision.places : -1;
+}
+
+int wkt_write_text(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom)
+{
+    int err;
+    struct text t;
+
+    w_init(&t, wkt, sink);
+    err = w_geom(&t, geom, 1);
+    free(t.xy);
+
+    return err;
+}
+
+/*
+ * Member i of a non-empty collection as it appears in the collection
+ * text: the first one is preceded by the collection type and opening
+ * parenthesis, the others by a comma. The closing parenthesis is left
+ * to the caller. Writing every member in turn gives the same text as
+ * wkt_write_text() on the collection.
+ */
+int wkt_write_text_member(
+    struct wkt *wkt,
+    struct wkt_sink *sink,
+    const GEOSGeometry *geom,
+    int i)
+{
+    int err;
+    struct text t;
+    int type = GEOSGeomTypeId_r(wkt->handle, geom);
+    const char *name = w_name(type);
+
+    if (name == NULL) {
+        fprintf(stderr, "Cannot write geometry type %d\n", type);
+        return 1;
+    }
+
+    w_init(&t, wkt, sink);
+    if (i == 0) {
+        w_put(&t, name);
+        w_put(&t, w_dims(GEOSHasZ_r(wkt->handle, geom) == 1,
+                         GEOSHasM_r(wkt->handle, geom) == 1));
+        w_put(&t, " (");
+    } else {
+        w_put(&t, ", ");
+    }
+    err = w_geom(&t, GEOSGetGeometryN_r(wkt->handle, geom, i),
+                 type == GEOS_GEOMETRYCOLLECTION);
+    free(t.xy);
+
+    return err;
+}
@@ -0,0 +1,125 @@
+/*
+   wktalloc.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+/*
+ * malloc and friends for the tools, passed on to glibc and reported
+ * to wkt_stats_alloc() and wkt_stats_free(), which count nothing until
+ * -A turns memory accounting on. GEOS allocates through operator new
+ * and so through malloc, which lets its geometries be charged to
+ * phases along with everything libwkt allocates.
+ *
+ * This is linked into the tools and not into the library, so programs
+ * using libwkt keep their own allocator. Under a sanitizer, which has
+ * its own malloc, and away from glibc nothing here is defined and -A
+ * reports no allocations.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "wkt.h"
+
+#if defined(__GLIBC__) && \
+    !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+
+    wkt_stats_alloc(ptr);
+
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __libc_calloc(nmemb, size);
+
+    wkt_stats_alloc(ptr);
+
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    wkt_stats_free(ptr);
+    p = __libc_realloc(ptr, size);
+    if (p) {
+        wkt_stats_alloc(p);
+    } else if (size) {
+        wkt_stats_alloc(ptr); /* failed, ptr is still live */
+    }
+
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+
+    wkt_stats_alloc(ptr);
+
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+
+    ptr = memalign(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    void *ptr = __libc_valloc(size);
+
+    wkt_stats_alloc(ptr);
+
+    return ptr;
+}
+
+void *pvalloc(size_t size)
+{
+    void *ptr = __libc_pvalloc(size);
+
+    wkt_stats_alloc(ptr);
+
+    return ptr;
+}
+
+void free(void *ptr)
+{
+    wkt_stats_free(ptr);
+    __libc_free(ptr);
+}
+
+#endif
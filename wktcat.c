@@ -0,0 +1,161 @@
+/*
+   wktcat.c
+
+   Copyright (c) 2021 by Daniel Kelley
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <geos_c.h>
+#include "wkt.h"
+
+struct info {
+    int verbose;
+    int stats;
+    int memory;
+    const char *trace;
+    struct wkt wkt;
+};
+
+static int w_op(struct info *info, const char *input, const char *output)
+{
+    int err;
+    const GEOSGeometry *geom = NULL;
+
+    err = wkt_open(&info->wkt);
+    if (!err) {
+        err = wkt_read(&info->wkt, input);
+    }
+    if (!err) {
+        geom = wkt_geometry(&info->wkt);
+        err = (geom == NULL);
+    }
+    if (!err) {
+        err = wkt_write(&info->wkt, output, geom);
+    }
+    wkt_close(&info->wkt);
+
+    return err;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(
+        stderr,
+        "%s -jn -of -Pn -X file [-AbBSvh] <input> [<output>]\n",
+        prog);
+    fprintf(stderr,"  -h        Print this message\n");
+    fprintf(stderr,"  -v        Verbose messages\n");
+    fprintf(stderr,"  -S        Print phase timings and counters as JSON\n");
+    fprintf(stderr,"  -A        Add memory use by phase to the -S report\n");
+    fprintf(stderr,"  -X file   Also write a Chrome trace of the phases\n");
+    fprintf(stderr,"  -j n      Parse WKT input and write output with n threads\n");
+    fprintf(stderr,"  -b        WKB input\n");
+    fprintf(stderr,"  -B        WKB HEX input\n");
+    fprintf(stderr,"            (columnar and FlatGeobuf input is detected)\n");
+    fprintf(stderr,"  -o f      Output format: a (WKT), b (WKB),\n");
+    fprintf(stderr,"            B (WKB HEX), C (columnar) or F (FlatGeobuf)\n");
+    fprintf(stderr,"  -P n      Write WKT with n decimal places\n");
+}
+
+static int set_output(struct info *info, const char *arg)
+{
+    int err = 0;
+
+    if (!strcmp(arg, "a")) {
+        info->wkt.writer = WKT_IO_ASCII;
+    } else if (!strcmp(arg, "b")) {
+        info->wkt.writer = WKT_IO_BINARY;
+    } else if (!strcmp(arg, "B")) {
+        info->wkt.writer = WKT_IO_HEX;
+    } else if (!strcmp(arg, "C")) {
+        info->wkt.writer = WKT_IO_COLUMNAR;
+    } else if (!strcmp(arg, "F")) {
+        info->wkt.writer = WKT_IO_FGB;
+    } else {
+        fprintf(stderr, "Unknown output format %s\n", arg);
+        err = 1;
+    }
+
+    return err;
+}
+
+int main(int argc, char *argv[])
+{
+    int err = 1;
+    int c;
+    int num_arg;
+    struct info info;
+
+    memset(&info, 0, sizeof(info));
+    info.wkt.reader = WKT_IO_ASCII;
+    info.wkt.writer = WKT_IO_COLUMNAR;
+
+    while ((c = getopt(argc, argv, "j:X:o:P:BbASvh")) != EOF) {
+        switch (c) {
+        case 'j':
+            info.wkt.threads = strtol(optarg,0,0);
+            break;
+        case 'o':
+            if (set_output(&info, optarg)) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'P':
+            info.wkt.precision.places = strtol(optarg,0,0);
+            info.wkt.precision.valid = 1;
+            break;
+        case 'v':
+            info.verbose = 1;
+            break;
+        case 'S':
+            info.stats = 1;
+            break;
+        case 'A':
+            info.memory = 1;
+            break;
+        case 'X':
+            info.trace = optarg;
+            break;
+        case 'b':
+            info.wkt.reader = WKT_IO_BINARY;
+            break;
+        case 'B':
+            info.wkt.reader = WKT_IO_HEX;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return(EXIT_SUCCESS);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (info.stats || info.trace || info.memory) {
+        wkt_stats_enable(info.trace);
+    }
+    if (info.memory) {
+        wkt_stats_memory();
+    }
+
+    num_arg = argc - optind;
+
+    if (num_arg == 1 || num_arg == 2) {
+        char *input = argv[optind];
+        char *output = (num_arg == 2) ? argv[optind+1] : NULL;
+        err = w_op(&info, input, output);
+    } else {
+        usage(argv[0]);
+        err = 1;
+    }
+
+    if (wkt_stats_report()) {
+        err = 1;
+    }
+
+    return err;
+}
@@ -10,24 +10,48 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <geos_c.h>
 #include "wkt.h"
 
 struct info {
     int verbose;
+    int stats;
+    int memory;
+    const char *trace;
+    int stream;
     int show_ring;
     const GEOSGeometry *ring;
     GEOSGeometry *geom;
+    GEOSGeometry **part; /* hull of each batch */
+    size_t nparts;
     struct wkt wkt;
 };
 
 static int w_hull(struct info *info)
 {
+    /* point input needs no Point each, just the coordinates */
+    GEOSGeometry *coords = wkt_coords(&info->wkt);
+    const GEOSGeometry *input = coords ? coords : wkt_geometry(&info->wkt);
+    uint64_t start;
+
+    if (input == NULL) {
+        fprintf(stderr, "No input geometry\n");
+        return 1;
+    }
+
+    start = wkt_stats_begin(WKT_PHASE_COMPUTE);
+
     info->geom = GEOSConvexHull_r(
         info->wkt.handle,
-        info->wkt.geom);
+        input);
 
     assert(info->geom != NULL);
+    wkt_stats_phase(WKT_PHASE_COMPUTE, start);
+
+    if (coords) {
+        GEOSGeom_destroy_r(info->wkt.handle, coords);
+    }
 
     if (info->show_ring) {
         info->ring = GEOSGetExteriorRing_r(
@@ -40,6 +64,78 @@ static int w_hull(struct info *info)
     return 0;
 }
 
+/* The hull of the batch hulls is the hull of the input. */
+static int w_hull_batch(
+    struct wkt *wkt,
+    const struct wkt_node *extent,
+    void *user_data)
+{
+    struct info *info = user_data;
+    GEOSGeometry **part;
+    GEOSGeometry *hull;
+    uint64_t start = wkt_stats_begin(WKT_PHASE_COMPUTE);
+
+    (void)extent;
+    hull = GEOSConvexHull_r(wkt->handle, wkt->geom);
+    wkt_stats_phase(WKT_PHASE_COMPUTE, start);
+    if (hull == NULL) {
+        return 1;
+    }
+
+    part = realloc(info->part, (info->nparts + 1) * sizeof(*part));
+    if (part == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        GEOSGeom_destroy_r(wkt->handle, hull);
+        return 1;
+    }
+    info->part = part;
+    info->part[info->nparts++] = hull;
+
+    return 0;
+}
+
+static int w_hull_batches(struct info *info, const char *input)
+{
+    int err;
+    size_t i;
+    GEOSGeometry *parts;
+
+    err = wkt_batch(&info->wkt, input, info->stream, w_hull_batch, info);
+
+    if (!err) {
+        /* takes over the batch hulls */
+        parts = GEOSGeom_createCollection_r(
+            info->wkt.handle,
+            GEOS_GEOMETRYCOLLECTION,
+            info->part,
+            info->nparts);
+        err = (parts == NULL);
+    }
+
+    if (!err) {
+        info->nparts = 0;
+        info->wkt.geom = parts;
+        err = w_hull(info);
+    }
+
+    for (i=0; i<info->nparts; i++) {
+        GEOSGeom_destroy_r(info->wkt.handle, info->part[i]);
+    }
+    free(info->part);
+
+    return err;
+}
+
+static void w_report(struct info *info)
+{
+    struct rusage usage;
+
+    if (info->verbose && !getrusage(RUSAGE_SELF, &usage)) {
+        fprintf(stderr, "peak RSS %ld KiB, budget %zu KiB\n",
+                usage.ru_maxrss, info->wkt.budget / 1024);
+    }
+}
+
 static void w_free(struct info *info)
 {
     if (info->geom) {
@@ -52,10 +148,15 @@ static int w_op(struct info *info, const char *input, const char *output)
     int err;
 
     err = wkt_open(&info->wkt);
-    if (!err) {
+    if (!err && info->wkt.budget) {
+        err = w_hull_batches(info, input);
+        w_report(info);
+    } else if (!err && info->stream) {
+        err = wkt_stream_points(&info->wkt, input);
+    } else if (!err) {
         err = wkt_read(&info->wkt, input);
     }
-    if (!err) {
+    if (!err && !info->wkt.budget) {
         err = w_hull(info);
     }
     if (!err) {
@@ -72,13 +173,24 @@ static void usage(const char *prog)
 {
     fprintf(
         stderr,
-        "%s [-bBvh] <input> [<output>]\n",
+        "%s -jn -M size -Pn -X file [-AbBCFlSvh] <input> [<output>]\n",
         prog);
     fprintf(stderr,"  -h        Print this message\n");
     fprintf(stderr,"  -v        Verbose messages\n");
+    fprintf(stderr,"  -S        Print phase timings and counters as JSON\n");
+    fprintf(stderr,"  -A        Add memory use by phase to the -S report\n");
+    fprintf(stderr,"  -X file   Also write a Chrome trace of the phases\n");
+    fprintf(stderr,"  -j n      Parse WKT input and write output with n threads\n");
     fprintf(stderr,"  -r        Generate Linear Ring\n");
     fprintf(stderr,"  -b        WKB IO\n");
     fprintf(stderr,"  -B        WKB HEX IO\n");
+    fprintf(stderr,"  -C        Columnar output (columnar input is detected)\n");
+    fprintf(stderr,"  -F        FlatGeobuf output (FlatGeobuf input is detected)\n");
+    fprintf(stderr,"  -l        Input is one record per line (WKT, HEX)\n");
+    fprintf(stderr,"            or length prefixed (WKB)\n");
+    fprintf(stderr,"  -M size   Work out of core in batches of about size\n");
+    fprintf(stderr,"            bytes (K, M, G suffixes)\n");
+    fprintf(stderr,"  -P n      Write WKT with n decimal places\n");
 }
 
 int main(int argc, char *argv[])
@@ -92,11 +204,35 @@ int main(int argc, char *argv[])
     info.wkt.reader = WKT_IO_ASCII;
     info.wkt.writer = WKT_IO_ASCII;
 
-    while ((c = getopt(argc, argv, "Bbervh")) != EOF) {
+    while ((c = getopt(argc, argv, "j:X:M:P:FCBberlASvh")) != EOF) {
         switch (c) {
+        case 'l':
+            info.stream = 1;
+            break;
+        case 'j':
+            info.wkt.threads = strtol(optarg,0,0);
+            break;
+        case 'M':
+            if (wkt_parse_size(optarg, &info.wkt.budget)) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'P':
+            info.wkt.precision.places = strtol(optarg,0,0);
+            info.wkt.precision.valid = 1;
+            break;
         case 'v':
             info.verbose = 1;
             break;
+        case 'S':
+            info.stats = 1;
+            break;
+        case 'A':
+            info.memory = 1;
+            break;
+        case 'X':
+            info.trace = optarg;
+            break;
         case 'r':
             info.show_ring = 1;
             break;
@@ -108,6 +244,12 @@ int main(int argc, char *argv[])
             info.wkt.reader = WKT_IO_HEX;
             info.wkt.writer = WKT_IO_HEX;
             break;
+        case 'C':
+            info.wkt.writer = WKT_IO_COLUMNAR;
+            break;
+        case 'F':
+            info.wkt.writer = WKT_IO_FGB;
+            break;
         case 'h':
             usage(argv[0]);
             return(EXIT_SUCCESS);
@@ -117,6 +259,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (info.stats || info.trace || info.memory) {
+        wkt_stats_enable(info.trace);
+    }
+    if (info.memory) {
+        wkt_stats_memory();
+    }
+
     num_arg = argc - optind;
 
     if (num_arg == 1 || num_arg == 2) {
@@ -128,5 +277,9 @@ int main(int argc, char *argv[])
         err = 1;
     }
 
+    if (wkt_stats_report()) {
+        err = 1;
+    }
+
     return err;
 }
@@ -11,6 +11,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <math.h>
+#include <sys/resource.h>
 #include <plot.h>
 #include <igraph/igraph.h>
 #include "wkt.h"
@@ -28,6 +30,19 @@
 
 struct info {
     int verbose;
+    int stats;
+    int memory;
+    const char *trace;
+    int stream;
+    int ready; /* plotter set up */
+    const char *input;
+    struct {
+        int valid;
+        double xmin;
+        double xmax;
+        double ymin;
+        double ymax;
+    } bounds;
     double width;
     const char *pen;
     const char *format;
@@ -36,6 +51,17 @@ struct info {
         int symbol;
         double size;
     } marker;
+    struct {
+        int on;
+        int valid;
+        int scanned; /* range found with the bounds */
+        double min;
+        double max;
+    } z; /* color by Z */
+    struct {
+        int compound; /* rings of one polygon */
+        int open; /* a subpath was drawn */
+    } path;
     int has_color;
     int polygon_idx;
     igraph_t color;
@@ -44,65 +70,179 @@ struct info {
     struct wkt wkt;
 };
 
-struct line_info {
-    struct info *info;
-    double prev[2];
-};
+static void w_pen(struct info *info)
+{
+    pl_pencolorname_r(info->plotter, info->pen ? info->pen : "black");
+}
+
+/* Pen color for z on a blue, cyan, green, yellow, red ramp. */
+static void w_zcolor(struct info *info, double z)
+{
+    static const int ramp[5][3] = {
+        {0, 0, 65535},
+        {0, 65535, 65535},
+        {0, 65535, 0},
+        {65535, 65535, 0},
+        {65535, 0, 0},
+    };
+    double t = 0.0;
+    double f;
+    int k;
+    int i;
+    int c[3];
+
+    if (isnan(z)) {
+        w_pen(info);
+        return;
+    }
+
+    if (info->z.max > info->z.min) {
+        t = 4.0 * (z - info->z.min) / (info->z.max - info->z.min);
+    }
+    if (t < 0.0) {
+        t = 0.0;
+    } else if (t > 4.0) {
+        t = 4.0;
+    }
+    k = (t < 4.0) ? (int)t : 3;
+    f = t - k;
+
+    for (i=0; i<3; i++) {
+        c[i] = ramp[k][i] + f * (ramp[k + 1][i] - ramp[k][i]);
+    }
+    pl_pencolor_r(info->plotter, c[0], c[1], c[2]);
+}
 
-static int w_point_iterator(
+static int w_point_span(
     struct wkt *wkt,
-    unsigned i,
-    unsigned n,
-    double x,
-    double y,
+    const struct wkt_span *span,
     void *user_data)
 {
     struct info *info = user_data;
+    int colored = (info->z.valid && span->z);
+    size_t i;
+    double x;
+    double y;
 
     (void)wkt;
-    if (info->verbose) {
-        fprintf(stderr, "Point %u/%u [%g,%g]\n", i, n, x, y);
+    for (i=0; i<span->n; i++) {
+        x = span->x[i * span->stride];
+        y = span->y[i * span->stride];
+        if (info->verbose) {
+            fprintf(stderr, "Point %zu/%zu [%g,%g]\n", i, span->n, x, y);
+        }
+        if (colored) {
+            w_zcolor(info, span->z[i * span->stride]);
+        }
+        if (info->marker.valid) {
+            pl_fmarker_r(info->plotter,
+                         x, y, info->marker.symbol, info->marker.size);
+        } else {
+            pl_fpoint_r(info->plotter, x, y);
+        }
     }
-    if (info->marker.valid) {
-        pl_fmarker_r(info->plotter,
-                     x, y, info->marker.symbol, info->marker.size);
-    } else {
-        pl_fpoint_r(info->plotter, x, y);
+    if (colored) {
+        w_pen(info);
     }
+    wkt_stats_count(WKT_STAT_PRIMITIVES, span->n);
 
     return 0;
 }
 
-static int w_line_iterator(
+/* Segment by segment, each in the color of the Z halfway along it. */
+static void w_line_zcolor(struct info *info, const struct wkt_span *span)
+{
+    size_t i;
+    double x;
+    double y;
+    double prev[2] = {0.0, 0.0};
+
+    for (i=0; i<span->n; i++) {
+        x = span->x[i * span->stride];
+        y = span->y[i * span->stride];
+        if (info->verbose) {
+            fprintf(stderr, "Line %zu/%zu [%g,%g]\n", i, span->n, x, y);
+        }
+        if (i > 0) {
+            w_zcolor(info, 0.5 * (span->z[(i - 1) * span->stride] +
+                                  span->z[i * span->stride]));
+            pl_fline_r(info->plotter, prev[0], prev[1], x, y);
+        }
+        prev[0] = x;
+        prev[1] = y;
+    }
+    w_pen(info);
+    if (span->n > 1) {
+        wkt_stats_count(WKT_STAT_PRIMITIVES, span->n - 1);
+    }
+}
+
+/*
+ * A line string or ring as one path, a move and then a continuation
+ * through each point; a ring is closed rather than drawn back to its
+ * start. Rings of a polygon are subpaths of one compound path that
+ * w_handle_polygon() ends, so holes stay holes.
+ */
+static int w_line_span(
     struct wkt *wkt,
-    unsigned i,
-    unsigned n,
-    double x,
-    double y,
+    const struct wkt_span *span,
     void *user_data)
 {
-    struct line_info *line_info = user_data;
-    struct info *info = line_info->info;
-    double *prev = line_info->prev;
+    struct info *info = user_data;
+    size_t n = span->n;
+    int closed;
+    size_t i;
+    double x;
+    double y;
 
     (void)wkt;
-    if (info->verbose) {
-        fprintf(stderr, "Line %u/%u [%g,%g]\n", i, n, x, y);
+    if (info->z.valid && span->z) {
+        w_line_zcolor(info, span);
+        return 0;
+    }
+    if (n < 2) {
+        return 0;
     }
 
-    if (i > 0) {
-        pl_fline_r(info->plotter, prev[0], prev[1], x, y);
+    closed = (span->type == GEOS_LINEARRING && n > 3 &&
+              span->x[0] == span->x[(n - 1) * span->stride] &&
+              span->y[0] == span->y[(n - 1) * span->stride]);
+    if (closed) {
+        n--;
+    }
+
+    if (info->path.open) {
+        pl_endsubpath_r(info->plotter);
+    }
+    for (i=0; i<n; i++) {
+        x = span->x[i * span->stride];
+        y = span->y[i * span->stride];
+        if (info->verbose) {
+            fprintf(stderr, "Line %zu/%zu [%g,%g]\n", i, span->n, x, y);
+        }
+        if (i == 0) {
+            pl_fmove_r(info->plotter, x, y);
+        } else {
+            pl_fcont_r(info->plotter, x, y);
+        }
+    }
+    if (closed) {
+        pl_closepath_r(info->plotter);
     }
 
-    prev[0] = x;
-    prev[1] = y;
+    if (info->path.compound) {
+        info->path.open = 1;
+    } else {
+        pl_endpath_r(info->plotter);
+        wkt_stats_count(WKT_STAT_PRIMITIVES, 1);
+    }
 
     return 0;
 }
 
 static int w_handle_point(struct info *info, const GEOSGeometry *geom)
 {
-    return wkt_iterate_coord_seq(&info->wkt, geom, w_point_iterator, info);
+    return wkt_iterate_span(&info->wkt, geom, w_point_span, info);
 }
 
 static int w_label_polygon(struct info *info)
@@ -118,6 +258,7 @@ static int w_label_polygon(struct info *info)
     snprintf(color_s, sizeof(color_s), "%g", color);
     pl_fmove_r(info->plotter, x, y);
     pl_alabel_r(info->plotter, 'c', 'c', color_s);
+    wkt_stats_count(WKT_STAT_PRIMITIVES, 1);
 
     return 0;
 }
@@ -128,9 +269,7 @@ static int w_handle_polygon(struct info *info, const GEOSGeometry *geom)
     int n;
     int i;
     const GEOSGeometry *g;
-    struct line_info line_info;
 
-    line_info.info = info;
     do {
         g = GEOSGetExteriorRing_r(info->wkt.handle, geom);
         if (g==NULL) {
@@ -144,7 +283,8 @@ static int w_handle_polygon(struct info *info, const GEOSGeometry *geom)
             }
         }
 
-        err = wkt_iterate_coord_seq(&info->wkt, g, w_line_iterator, &line_info);
+        info->path.compound = 1;
+        err = wkt_iterate_span(&info->wkt, g, w_line_span, info);
         if (err) {
             break;
         }
@@ -157,7 +297,7 @@ static int w_handle_polygon(struct info *info, const GEOSGeometry *geom)
                 break;
             }
 
-            err = wkt_iterate_coord_seq(&info->wkt, g, w_line_iterator, &line_info);
+            err = wkt_iterate_span(&info->wkt, g, w_line_span, info);
             if (err) {
                 break;
             }
@@ -167,43 +307,241 @@ static int w_handle_polygon(struct info *info, const GEOSGeometry *geom)
 
     } while (0);
 
+    if (info->path.open) {
+        pl_endpath_r(info->plotter);
+        wkt_stats_count(WKT_STAT_PRIMITIVES, 1);
+    }
+    info->path.compound = 0;
+    info->path.open = 0;
+
     return err;
 }
 
 static int w_handle_linestring(struct info *info, const GEOSGeometry *geom)
 {
-    int err;
-    struct line_info line_info;
+    return wkt_iterate_span(&info->wkt, geom, w_line_span, info);
+}
 
-    line_info.info = info;
+static int w_visit(struct wkt *wkt,
+                   const GEOSGeometry *geom,
+                   int type,
+                   void *user_data)
+{
+    int err = 1;
+    struct info *info = user_data;
 
-    err = wkt_iterate_coord_seq(&info->wkt, geom, w_line_iterator, &line_info);
+    (void)wkt;
+    switch (type) {
+    case GEOS_POINT:
+        err = w_handle_point(info, geom);
+        break;
+    case GEOS_POLYGON:
+        err = w_handle_polygon(info, geom);
+        break;
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        err = w_handle_linestring(info, geom);
+        break;
+    default:
+        fprintf(stderr,"Missing handler for geometry type %d\n", type);
+        break;
+    }
 
     return err;
 }
 
+/* Multi* members and nested collections are drawn part by part. */
 static int w_handle(struct wkt *wkt,
                     const GEOSGeometry *geom,
                     const char *gtype,
                     void *user_data)
 {
-    int err = 1;
+    (void)gtype;
+    return wkt_traverse(wkt, geom, w_visit, user_data);
+}
+
+static int w_meets(const struct info *info, const struct wkt_node *box)
+{
+    const struct wkt_node *view = &info->wkt.view.box;
+
+    return box->minx <= view->maxx && box->maxx >= view->minx &&
+        box->miny <= view->maxy && box->maxy >= view->miny;
+}
+
+/* w_handle() for features that meet the viewport, the rest are skipped. */
+static int w_handle_view(struct wkt *wkt,
+                         const GEOSGeometry *geom,
+                         const char *gtype,
+                         void *user_data)
+{
+    struct info *info = user_data;
+    struct wkt_node box;
+
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0;
+    }
+    if (!GEOSGeom_getExtent_r(wkt->handle, geom,
+                              &box.minx, &box.miny, &box.maxx, &box.maxy)) {
+        return 1;
+    }
+
+    return w_meets(info, &box) ? w_handle(wkt, geom, gtype, info) : 0;
+}
+
+static void w_merge_z(struct info *info, double zmin, double zmax)
+{
+    if (!info->z.valid) {
+        info->z.min = zmin;
+        info->z.max = zmax;
+        info->z.valid = 1;
+    } else {
+        if (zmin < info->z.min) {
+            info->z.min = zmin;
+        }
+        if (zmax > info->z.max) {
+            info->z.max = zmax;
+        }
+    }
+}
+
+static int w_extend_z(struct wkt *wkt,
+                      const GEOSGeometry *geom,
+                      const char *gtype,
+                      void *user_data)
+{
     struct info *info = user_data;
+    double zmin;
+    double zmax;
+
+    (void)gtype;
+    if (wkt_bounds_z(wkt, geom, &zmin, &zmax)) {
+        w_merge_z(info, zmin, zmax);
+    }
+
+    return 0;
+}
+
+/* Z range of flat spans, which have no geometry to ask. */
+static int w_flat_z(
+    struct wkt *wkt,
+    const struct wkt_span *span,
+    void *user_data)
+{
+    size_t i;
+    double z;
 
     (void)wkt;
-    if (!strcmp(gtype, "Point")) {
-        err = w_handle_point(info, geom);
-    } else if (!strcmp(gtype, "Polygon")) {
-        err = w_handle_polygon(info, geom);
-    } else if (!strcmp(gtype, "LineString")) {
-        err = w_handle_linestring(info, geom);
-    } else if (!strcmp(gtype, "LinearRing")) {
-        err = w_handle_linestring(info, geom);
+    if (span->z == NULL) {
+        return 0;
+    }
+
+    for (i=0; i<span->n; i++) {
+        z = span->z[i * span->stride];
+        if (z == z) { /* not NaN */
+            w_merge_z(user_data, z, z);
+        }
+    }
+
+    return 0;
+}
+
+static int w_extend(struct wkt *wkt,
+                    const GEOSGeometry *geom,
+                    const char *gtype,
+                    void *user_data)
+{
+    struct info *info = user_data;
+    double xmin;
+    double xmax;
+    double ymin;
+    double ymax;
+
+    (void)gtype;
+    if (GEOSisEmpty_r(wkt->handle, geom)) {
+        return 0;
+    }
+
+    if (!GEOSGeom_getExtent_r(wkt->handle, geom,
+                              &xmin, &ymin, &xmax, &ymax)) {
+        return 1;
+    }
+
+    if (!info->bounds.valid) {
+        info->bounds.xmin = xmin;
+        info->bounds.xmax = xmax;
+        info->bounds.ymin = ymin;
+        info->bounds.ymax = ymax;
+        info->bounds.valid = 1;
     } else {
-        fprintf(stderr,"Missing handler for %s\n", gtype);
+        if (xmin < info->bounds.xmin) {
+            info->bounds.xmin = xmin;
+        }
+        if (xmax > info->bounds.xmax) {
+            info->bounds.xmax = xmax;
+        }
+        if (ymin < info->bounds.ymin) {
+            info->bounds.ymin = ymin;
+        }
+        if (ymax > info->bounds.ymax) {
+            info->bounds.ymax = ymax;
+        }
     }
 
-    return err;
+    if (info->z.on) {
+        w_extend_z(wkt, geom, gtype, info);
+    }
+
+    return 0;
+}
+
+/* Streamed input has to be read once just to find the bounds. */
+static int w_stream_bounds(
+    struct info *info,
+    double *xmin,
+    double *xmax,
+    double *ymin,
+    double *ymax)
+{
+    int err;
+
+    err = wkt_stream(&info->wkt, info->input, w_extend, info);
+    info->z.scanned = !err;
+    if (!err && info->bounds.valid) {
+        *xmin = info->bounds.xmin;
+        *xmax = info->bounds.xmax;
+        *ymin = info->bounds.ymin;
+        *ymax = info->bounds.ymax;
+    }
+
+    /* same sense as wkt_bounds() */
+    return !err && info->bounds.valid;
+}
+
+/* The Z range to color by, unless it came with the bounds. */
+static int w_setup_z(struct info *info)
+{
+    const GEOSGeometry *geom;
+
+    if (!info->z.on || info->z.scanned) {
+        return 0;
+    }
+    info->z.scanned = 1;
+
+    if (info->stream) {
+        return wkt_stream(&info->wkt, info->input, w_extend_z, info);
+    }
+    if (info->wkt.geom == NULL && info->wkt.flat.n) {
+        /* only columnar input has flat Z */
+        return wkt_iterate_flat_span(&info->wkt, -1, w_flat_z, info);
+    }
+
+    geom = wkt_geometry(&info->wkt);
+    if (geom == NULL) {
+        return 1;
+    }
+    info->z.valid = wkt_bounds_z(&info->wkt, geom, &info->z.min, &info->z.max);
+
+    return 0;
 }
 
 static int w_setup(struct info *info)
@@ -217,7 +555,25 @@ static int w_setup(struct info *info)
     double ymax = 1000.0;
 
     do {
-        rc = wkt_bounds(&info->wkt, &xmin, &xmax, &ymin, &ymax);
+        if (info->wkt.view.valid) {
+            /* plot the viewport, not the data */
+            xmin = info->wkt.view.box.minx;
+            xmax = info->wkt.view.box.maxx;
+            ymin = info->wkt.view.box.miny;
+            ymax = info->wkt.view.box.maxy;
+            rc = 1;
+        } else if (info->bounds.valid) {
+            /* already known */
+            xmin = info->bounds.xmin;
+            xmax = info->bounds.xmax;
+            ymin = info->bounds.ymin;
+            ymax = info->bounds.ymax;
+            rc = 1;
+        } else if (info->stream) {
+            rc = w_stream_bounds(info, &xmin, &xmax, &ymin, &ymax);
+        } else {
+            rc = wkt_bounds(&info->wkt, &xmin, &xmax, &ymin, &ymax);
+        }
         if (!rc) {
             break;
         }
@@ -226,35 +582,184 @@ static int w_setup(struct info *info)
             fprintf(stderr, "bounds: [%g,%g,%g,%g]\n",xmin,xmax,ymin,ymax);
         }
 
-        err = 0;
+        err = w_setup_z(info);
+        if (err) {
+            break;
+        }
+        if (info->verbose && info->z.valid) {
+            fprintf(stderr, "Z range: [%g,%g]\n", info->z.min, info->z.max);
+        }
 
         /* setup plotter */
         pl_fspace_r(info->plotter, xmin, ymin, xmax, ymax);
         pl_flinewidth_r(info->plotter, info->width);
-        pl_pencolorname_r(info->plotter, info->pen ? info->pen : "black");
+        w_pen(info);
         pl_erase_r(info->plotter);
     } while (0);
 
     return err;
 }
 
+/* Flat points inside the viewport, a run at a time. */
+static int w_flat_point_view(
+    struct wkt *wkt,
+    const struct wkt_span *span,
+    void *user_data)
+{
+    int err = 0;
+    struct info *info = user_data;
+    struct wkt_span run = *span;
+    struct wkt_node box;
+    size_t i;
+    size_t from = 0;
+
+    for (i=0; !err && i<=span->n; i++) {
+        if (i < span->n) {
+            box.minx = box.maxx = span->x[i];
+            box.miny = box.maxy = span->y[i];
+            if (w_meets(info, &box)) {
+                continue;
+            }
+        }
+        if (i > from) {
+            run.n = i - from;
+            run.x = span->x + from;
+            run.y = span->y + from;
+            run.z = span->z ? span->z + from : NULL;
+            run.m = span->m ? span->m + from : NULL;
+            err = w_point_span(wkt, &run, info);
+        }
+        from = i + 1;
+    }
+
+    return err;
+}
+
+/* Flat sequences whose box meets the viewport. */
+static int w_flat_line_view(
+    struct wkt *wkt,
+    const struct wkt_span *span,
+    void *user_data)
+{
+    struct info *info = user_data;
+    struct wkt_node box;
+
+    box.minx = box.miny = HUGE_VAL;
+    box.maxx = box.maxy = -HUGE_VAL;
+    wkt_minmax(span->x, span->y, span->n, &box);
+
+    return w_meets(info, &box) ? w_line_span(wkt, span, info) : 0;
+}
+
+/*
+ * Flat input (point-only WKT, columnar files) can be drawn straight
+ * from its coordinate arrays. Polygon labels need GEOS geometry.
+ */
+static int w_interpret_flat(struct info *info)
+{
+    int err;
+    int view = info->wkt.view.valid;
+    wkt_span_t point = view ? w_flat_point_view : w_point_span;
+    wkt_span_t line = view ? w_flat_line_view : w_line_span;
+
+    err = wkt_iterate_flat_span(&info->wkt, GEOS_POINT, point, info);
+    if (!err) {
+        err = wkt_iterate_flat_span(&info->wkt, GEOS_LINESTRING, line, info);
+    }
+    if (!err) {
+        err = wkt_iterate_flat_span(&info->wkt, GEOS_LINEARRING, line, info);
+    }
+
+    return err;
+}
+
+/* Features outside the viewport can be skipped, unless labelled. */
+static int w_view(const struct info *info)
+{
+    return info->wkt.view.valid && !info->has_color;
+}
+
 static int w_interpret(struct info *info)
 {
     int err = 1;
+    const struct wkt_flat *flat = &info->wkt.flat;
 
     /* interpret */
-    err = wkt_iterate(&info->wkt, w_handle, info);
+    if (!info->stream && !info->has_color && info->wkt.geom == NULL &&
+        (flat->n || flat->nodes)) {
+        err = w_interpret_flat(info);
+    } else if (info->stream) {
+        err = wkt_stream(&info->wkt, info->input,
+                         w_view(info) ? w_handle_view : w_handle, info);
+    } else if (w_view(info)) {
+        /* only the features the index finds in the viewport */
+        err = wkt_query(&info->wkt, &info->wkt.view.box, w_handle, info);
+    } else {
+        err = wkt_iterate(&info->wkt, w_handle, info);
+    }
+
+    return err;
+}
+
+/* The extent comes with the first batch, so set up there. */
+static int w_batch(
+    struct wkt *wkt,
+    const struct wkt_node *extent,
+    void *user_data)
+{
+    int err = 0;
+    struct info *info = user_data;
+    uint64_t start;
+
+    if (!info->ready) {
+        info->bounds.xmin = extent->minx;
+        info->bounds.xmax = extent->maxx;
+        info->bounds.ymin = extent->miny;
+        info->bounds.ymax = extent->maxy;
+        info->bounds.valid = 1;
+        err = w_setup(info);
+        info->ready = !err;
+    }
+
+    if (!err) {
+        start = wkt_stats_begin(WKT_PHASE_PLOT);
+        err = wkt_iterate(wkt, w_view(info) ? w_handle_view : w_handle, info);
+        wkt_stats_phase(WKT_PHASE_PLOT, start);
+    }
 
     return err;
 }
 
+static void w_report(struct info *info)
+{
+    struct rusage usage;
+
+    if (info->verbose && !getrusage(RUSAGE_SELF, &usage)) {
+        fprintf(stderr, "peak RSS %ld KiB, budget %zu KiB\n",
+                usage.ru_maxrss, info->wkt.budget / 1024);
+    }
+}
+
 static int w_scan(struct info *info)
 {
     int err;
+    uint64_t start;
+
+    if (info->wkt.budget) {
+        err = wkt_batch(&info->wkt, info->input, info->stream, w_batch, info);
+        if (!err && !info->ready) {
+            fprintf(stderr, "Nothing to plot\n");
+            err = 1;
+        }
+        w_report(info);
+        return err;
+    }
 
     err = w_setup(info);
     if (!err) {
+        start = wkt_stats_begin(WKT_PHASE_PLOT);
         err = w_interpret(info);
+        wkt_stats_phase(WKT_PHASE_PLOT, start);
     }
 
     return err;
@@ -375,6 +880,38 @@ static int set_point_format(struct info *info, const char *arg)
     return err;
 }
 
+static int set_view(struct info *info, const char *arg)
+{
+    int err = 1;
+    double v[4];
+    const char *p = arg;
+    char *endp;
+    int i;
+
+    for (i=0; i<4; i++) {
+        errno = 0;
+        v[i] = strtod(p, &endp);
+        if (errno || endp == p || *endp != ((i < 3) ? ',' : 0)) {
+            /* Some kind of conversion error. */
+            break;
+        }
+        p = endp + 1;
+    }
+
+    if (i == 4 && v[0] < v[2] && v[1] < v[3]) {
+        info->wkt.view.box.minx = v[0];
+        info->wkt.view.box.miny = v[1];
+        info->wkt.view.box.maxx = v[2];
+        info->wkt.view.box.maxy = v[3];
+        info->wkt.view.valid = 1;
+        err = 0;
+    } else {
+        fprintf(stderr, "Error converting %s\n",arg);
+    }
+
+    return err;
+}
+
 static int color_read(struct info *info, const char *filename)
 {
     int err = 1;
@@ -402,15 +939,29 @@ static void color_cleanup(struct info *info)
 
 static void usage(const char *prog)
 {
-    fprintf(stderr,"%s -T format -O opt -p fmt [-bBvh] <input>\n", prog);
+    fprintf(stderr,"%s -T format -O opt -p fmt -j n -V box -M size -X file [-AbBlzSvh] <input>\n", prog);
     fprintf(stderr,"  -h        Print this message\n");
     fprintf(stderr,"  -w n      Line width\n");
     fprintf(stderr,"  -p n[,m]  Points are marker n size m\n");
     fprintf(stderr,"  -T format Output format\n");
     fprintf(stderr,"  -c gml    Read color GML file\n");
+    fprintf(stderr,"  -z        Color by Z, blue (low) to red (high)\n");
     fprintf(stderr,"  -b        Input is WKB\n");
     fprintf(stderr,"  -B        Input is WKH\n");
+    fprintf(stderr,"            (columnar input is detected)\n");
+    fprintf(stderr,"  -l        Input is one record per line (WKT, WKH)\n");
+    fprintf(stderr,"            or length prefixed (WKB)\n");
+    fprintf(stderr,"  -j n      Parse WKT input with n threads\n");
+    fprintf(stderr,"  -M size   Work out of core in batches of about size\n");
+    fprintf(stderr,"            bytes (K, M, G suffixes)\n");
+    fprintf(stderr,"  -V x0,y0,x1,y1\n");
+    fprintf(stderr,"            Plot only this box, drawing only the features\n");
+    fprintf(stderr,"            that meet it; indexed FlatGeobuf input reads\n");
+    fprintf(stderr,"            only those\n");
     fprintf(stderr,"  -v        Verbose\n");
+    fprintf(stderr,"  -S        Print phase timings and counters as JSON\n");
+    fprintf(stderr,"  -A        Add memory use by phase to the -S report\n");
+    fprintf(stderr,"  -X file   Also write a Chrome trace of the phases\n");
     fprintf(stderr,"  -O opt=v  Output option=v\n");
 }
 
@@ -428,7 +979,7 @@ int main(int argc, char *argv[])
     info.format = "svg";
     assert(info.param != NULL);
 
-    while ((c = getopt(argc, argv, "w:T:O:c:p:bBvh")) != EOF) {
+    while ((c = getopt(argc, argv, "j:w:T:O:c:p:V:M:X:bBlzASvh")) != EOF) {
         switch (c) {
         case 'w':
             info.width = strtod(optarg,0);
@@ -445,15 +996,41 @@ int main(int argc, char *argv[])
         case 'p':
             set_point_format(&info, optarg);
             break;
+        case 'V':
+            set_view(&info, optarg);
+            break;
+        case 'M':
+            if (wkt_parse_size(optarg, &info.wkt.budget)) {
+                return EXIT_FAILURE;
+            }
+            break;
         case 'b':
             info.wkt.reader = WKT_IO_BINARY;
             break;
         case 'B':
             info.wkt.reader = WKT_IO_HEX;
             break;
+        case 'l':
+            info.stream = 1;
+            break;
+        case 'z':
+            info.z.on = 1;
+            break;
+        case 'j':
+            info.wkt.threads = strtol(optarg,0,0);
+            break;
         case 'v':
             info.verbose = 1;
             break;
+        case 'S':
+            info.stats = 1;
+            break;
+        case 'A':
+            info.memory = 1;
+            break;
+        case 'X':
+            info.trace = optarg;
+            break;
         case 'h':
             usage(argv[0]);
             err = EXIT_SUCCESS;
@@ -463,13 +1040,31 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (optind < argc) {
+    if (info.stats || info.trace || info.memory) {
+        wkt_stats_enable(info.trace);
+    }
+    if (info.memory) {
+        wkt_stats_memory();
+    }
+
+    if (info.wkt.budget && color_file) {
+        /* batches come in spatial order, labels go by input order */
+        fprintf(stderr, "Color labels (-c) need the whole input (no -M)\n");
+    } else if (info.wkt.budget && info.z.on) {
+        /* the Z range has to be known before the first batch */
+        fprintf(stderr, "Color by Z (-z) needs the whole input (no -M)\n");
+    } else if (optind < argc && info.stream && !info.wkt.budget &&
+               !strcmp(argv[optind], "-")) {
+        /* bounds and rendering each need a pass over the input */
+        fprintf(stderr, "Record input (-l) cannot be read from stdin\n");
+    } else if (optind < argc) {
+        info.input = argv[optind];
         err = wkt_open(&info.wkt);
         if (!err && color_file) {
             err = color_read(&info, color_file);
         }
-        if (!err) {
-            err = wkt_read(&info.wkt, argv[optind]);
+        if (!err && !info.stream && !info.wkt.budget) {
+            err = wkt_read(&info.wkt, info.input);
         }
         if (!err) {
             err = w_plot(&info);
@@ -480,5 +1075,9 @@ int main(int argc, char *argv[])
         wkt_close(&info.wkt);
     }
 
+    if (wkt_stats_report()) {
+        err = 1;
+    }
+
     return err;
 }
@@ -18,6 +18,9 @@
 
 struct info {
     int verbose;
+    int stats;
+    int memory;
+    const char *trace;
     int unique;
     int backstop;
     double interval; /* quantized; 0.0 = none */
@@ -108,6 +111,7 @@ static int w_random(struct info *info)
     double y;
     GEOSGeometry *geom;
     long backstop = info->backstop * info->count;
+    uint64_t start = wkt_stats_begin(WKT_PHASE_COMPUTE);
 
     info->point = calloc(info->count, sizeof(*info->point));
     assert(info->point != NULL);
@@ -136,6 +140,7 @@ static int w_random(struct info *info)
         info->points);
 
     assert(info->geom != NULL);
+    wkt_stats_phase(WKT_PHASE_COMPUTE, start);
 
     return 0;
 }
@@ -173,13 +178,18 @@ static void usage(const char *prog)
 {
     fprintf(
         stderr,
-        "%s -xf -yf -sn -nn -qf -rf -Nn [-bBuvh] <output>\n",
+        "%s -xf -yf -sn -nn -qf -rf -Nn -Pn -X file [-AbBCFuSvh] <output>\n",
         prog);
     fprintf(stderr,"  -h        Print this message\n");
     fprintf(stderr,"  -v        Verbose messages\n");
+    fprintf(stderr,"  -S        Print phase timings and counters as JSON\n");
+    fprintf(stderr,"  -A        Add memory use by phase to the -S report\n");
+    fprintf(stderr,"  -X file   Also write a Chrome trace of the phases\n");
     fprintf(stderr,"  -u        Ensure points are unique\n");
     fprintf(stderr,"  -b        WKB output\n");
     fprintf(stderr,"  -B        WKB HEX output\n");
+    fprintf(stderr,"  -C        Columnar output\n");
+    fprintf(stderr,"  -F        FlatGeobuf output\n");
     fprintf(stderr,"  -x n      Output width\n");
     fprintf(stderr,"  -y n      Output height\n");
     fprintf(stderr,"  -s f      Random seed\n");
@@ -187,6 +197,7 @@ static void usage(const char *prog)
     fprintf(stderr,"  -q f      Quantization interval\n");
     fprintf(stderr,"  -r f      Minimum distance\n");
     fprintf(stderr,"  -N n      Uniqueness/distance retries\n");
+    fprintf(stderr,"  -P n      Write WKT with n decimal places\n");
 }
 
 int main(int argc, char *argv[])
@@ -200,7 +211,7 @@ int main(int argc, char *argv[])
     info.wkt.writer = WKT_IO_ASCII;
     info.backstop = BACKSTOP;
 
-    while ((c = getopt(argc, argv, "x:y:s:n:q:r:N:Bbuvh")) != EOF) {
+    while ((c = getopt(argc, argv, "X:x:y:s:n:q:r:N:P:FCBbuASvh")) != EOF) {
         switch (c) {
         case 'x':
             info.width = strtod(optarg,0);
@@ -225,6 +236,10 @@ int main(int argc, char *argv[])
             /* implies -u */
             info.unique = 1;
             break;
+        case 'P':
+            info.wkt.precision.places = strtol(optarg,0,0);
+            info.wkt.precision.valid = 1;
+            break;
         case 'N':
             info.backstop = strtol(optarg,0,0);
             break;
@@ -234,12 +249,27 @@ int main(int argc, char *argv[])
         case 'v':
             info.verbose = 1;
             break;
+        case 'S':
+            info.stats = 1;
+            break;
+        case 'A':
+            info.memory = 1;
+            break;
+        case 'X':
+            info.trace = optarg;
+            break;
         case 'b':
             info.wkt.writer = WKT_IO_BINARY;
             break;
         case 'B':
             info.wkt.writer = WKT_IO_HEX;
             break;
+        case 'C':
+            info.wkt.writer = WKT_IO_COLUMNAR;
+            break;
+        case 'F':
+            info.wkt.writer = WKT_IO_FGB;
+            break;
         case 'h':
             usage(argv[0]);
             return(EXIT_SUCCESS);
@@ -249,6 +279,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (info.stats || info.trace || info.memory) {
+        wkt_stats_enable(info.trace);
+    }
+    if (info.memory) {
+        wkt_stats_memory();
+    }
+
     num_arg = argc - optind;
 
     if (num_arg <= 1) {
@@ -259,5 +296,9 @@ int main(int argc, char *argv[])
         err = 1;
     }
 
+    if (wkt_stats_report()) {
+        err = 1;
+    }
+
     return err;
 }
@@ -15,6 +15,10 @@
 
 struct info {
     int verbose;
+    int stats;
+    int memory;
+    const char *trace;
+    int stream;
     double tolerance;
     int only_edges;
     GEOSGeometry *geom;
@@ -23,14 +27,31 @@ struct info {
 
 static int w_voronoi(struct info *info)
 {
+    /* point input needs no Point each, just the coordinates */
+    GEOSGeometry *coords = wkt_coords(&info->wkt);
+    const GEOSGeometry *input = coords ? coords : wkt_geometry(&info->wkt);
+    uint64_t start;
+
+    if (input == NULL) {
+        fprintf(stderr, "No input geometry\n");
+        return 1;
+    }
+
+    start = wkt_stats_begin(WKT_PHASE_COMPUTE);
+
     info->geom = GEOSVoronoiDiagram_r(
         info->wkt.handle,
-        info->wkt.geom,
+        input,
         NULL,
         info->tolerance,
         info->only_edges);
 
     assert(info->geom != NULL);
+    wkt_stats_phase(WKT_PHASE_COMPUTE, start);
+
+    if (coords) {
+        GEOSGeom_destroy_r(info->wkt.handle, coords);
+    }
 
     return 0;
 }
@@ -47,7 +68,9 @@ static int w_op(struct info *info, const char *input, const char *output)
     int err;
 
     err = wkt_open(&info->wkt);
-    if (!err) {
+    if (!err && info->stream) {
+        err = wkt_stream_points(&info->wkt, input);
+    } else if (!err) {
         err = wkt_read(&info->wkt, input);
     }
     if (!err) {
@@ -66,14 +89,23 @@ static void usage(const char *prog)
 {
     fprintf(
         stderr,
-        "%s -tf [-bBevh] <input> [<output>]\n",
+        "%s -tf -jn -Pn -X file [-AbBCFelSvh] <input> [<output>]\n",
         prog);
     fprintf(stderr,"  -h        Print this message\n");
     fprintf(stderr,"  -v        Verbose messages\n");
+    fprintf(stderr,"  -S        Print phase timings and counters as JSON\n");
+    fprintf(stderr,"  -A        Add memory use by phase to the -S report\n");
+    fprintf(stderr,"  -X file   Also write a Chrome trace of the phases\n");
+    fprintf(stderr,"  -j n      Parse WKT input and write output with n threads\n");
     fprintf(stderr,"  -b        WKB IO\n");
     fprintf(stderr,"  -B        WKB HEX IO\n");
+    fprintf(stderr,"  -C        Columnar output (columnar input is detected)\n");
+    fprintf(stderr,"  -F        FlatGeobuf output (FlatGeobuf input is detected)\n");
+    fprintf(stderr,"  -l        Input is one record per line (WKT, HEX)\n");
+    fprintf(stderr,"            or length prefixed (WKB)\n");
     fprintf(stderr,"  -t f      Tolerance\n");
     fprintf(stderr,"  -e        Only edges\n");
+    fprintf(stderr,"  -P n      Write WKT with n decimal places\n");
 }
 
 int main(int argc, char *argv[])
@@ -87,17 +119,36 @@ int main(int argc, char *argv[])
     info.wkt.reader = WKT_IO_ASCII;
     info.wkt.writer = WKT_IO_ASCII;
 
-    while ((c = getopt(argc, argv, "t:Bbevh")) != EOF) {
+    while ((c = getopt(argc, argv, "j:X:t:P:FCBbelASvh")) != EOF) {
         switch (c) {
         case 't':
             info.tolerance = strtod(optarg,0);
             break;
+        case 'P':
+            info.wkt.precision.places = strtol(optarg,0,0);
+            info.wkt.precision.valid = 1;
+            break;
         case 'e':
             info.only_edges = 1;
             break;
+        case 'l':
+            info.stream = 1;
+            break;
+        case 'j':
+            info.wkt.threads = strtol(optarg,0,0);
+            break;
         case 'v':
             info.verbose = 1;
             break;
+        case 'S':
+            info.stats = 1;
+            break;
+        case 'A':
+            info.memory = 1;
+            break;
+        case 'X':
+            info.trace = optarg;
+            break;
         case 'b':
             info.wkt.reader = WKT_IO_BINARY;
             info.wkt.writer = WKT_IO_BINARY;
@@ -106,6 +157,12 @@ int main(int argc, char *argv[])
             info.wkt.reader = WKT_IO_HEX;
             info.wkt.writer = WKT_IO_HEX;
             break;
+        case 'C':
+            info.wkt.writer = WKT_IO_COLUMNAR;
+            break;
+        case 'F':
+            info.wkt.writer = WKT_IO_FGB;
+            break;
         case 'h':
             usage(argv[0]);
             return(EXIT_SUCCESS);
@@ -115,6 +172,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (info.stats || info.trace || info.memory) {
+        wkt_stats_enable(info.trace);
+    }
+    if (info.memory) {
+        wkt_stats_memory();
+    }
+
     num_arg = argc - optind;
 
     if (num_arg == 1 || num_arg == 2) {
@@ -126,5 +190,9 @@ int main(int argc, char *argv[])
         err = 1;
     }
 
+    if (wkt_stats_report()) {
+        err = 1;
+    }
+
     return err;
 }